@@ -32,6 +32,21 @@
 #include <queue>
 #include <unordered_map>
 #include <utility>
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <memory>
+#include <deque>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <string>
+#include <tuple>
+#include <array>
+#include <limits>
+#include <cmath>
+#include <istream>
+#include <sstream>
 
 struct TreeNode
 {
@@ -56,6 +71,346 @@ void get_map_of_levels_info(
 
 std::vector<double> average_of_levels_2(TreeNode * root);
 
+/*
+ * A frozen, pointer-free copy of a tree.
+ *
+ * The values are stored breadth-first, so level l occupies the contiguous
+ * range [ level_offsets[l], level_offsets[l + 1] ) of 'values'.
+ * 'left_child' and 'right_child' hold the index of each node's children
+ * in 'values', or -1 when the child is missing.
+ */
+struct FlatTree
+{
+	std::vector<int> values;
+	std::vector<int> left_child;
+	std::vector<int> right_child;
+	std::vector<std::size_t> level_offsets;
+
+	std::size_t num_levels() const
+	{
+		return level_offsets.empty() ? 0 : level_offsets.size() - 1;
+	}
+};
+
+FlatTree flatten_tree(TreeNode * root);
+
+std::vector<double> average_of_levels_3(FlatTree const& tree);
+
+/*
+ * A unit of work for 'average_of_levels_4': a subtree, and the level of its root.
+ */
+struct SubtreeTask
+{
+	TreeNode * node;
+	int level;
+};
+
+/*
+ * The task queue of one worker. The owner pushes and pops at the back,
+ * thieves steal from the front, so they take the oldest, and usually
+ * the largest, subtrees.
+ */
+class WorkStealingQueue
+{
+public:
+	void push(SubtreeTask const& task);
+	bool pop(SubtreeTask & task);
+	bool steal(SubtreeTask & task);
+
+	std::size_t size() const
+	{
+		return num_tasks.load(std::memory_order_relaxed);
+	}
+
+private:
+	std::mutex mutex;
+	std::deque<SubtreeTask> tasks;
+	std::atomic<std::size_t> num_tasks { 0 };
+};
+
+std::vector<double> average_of_levels_4(
+	TreeNode * root,
+	unsigned num_threads = std::thread::hardware_concurrency());
+
+/*
+ * A tree that keeps the (sum, count) of each of its levels up to date as
+ * it is edited, so the averages can be read in O(levels) at any time.
+ *
+ * A node is addressed by its path from the root: a string of 'L' and 'R'
+ * characters, where "" is the root and "LR" is the right child of the
+ * left child of the root. Every edit walks its path, so it costs
+ * O(depth). A graft also adds the levels of the grafted subtree, in
+ * O(height of the subtree). A prune has to visit each pruned node once to
+ * build the level table of the subtree it returns.
+ *
+ * The edits return false, and leave the tree untouched, when the path
+ * does not fit the edit (e.g. inserting over an existing node).
+ */
+class LevelStatsTree
+{
+public:
+	LevelStatsTree() = default;
+
+	// Takes ownership of the nodes of 'root'.
+	explicit LevelStatsTree(TreeNode * root);
+
+	LevelStatsTree(LevelStatsTree && other);
+	LevelStatsTree & operator=(LevelStatsTree && other);
+
+	LevelStatsTree(LevelStatsTree const&) = delete;
+	LevelStatsTree & operator=(LevelStatsTree const&) = delete;
+
+	~LevelStatsTree();
+
+	TreeNode * root() const
+	{
+		return root_node;
+	}
+
+	bool insert_leaf(std::string const& path, int val);
+	bool delete_leaf(std::string const& path);
+	bool update_value(std::string const& path, int val);
+	bool graft(std::string const& path, LevelStatsTree && subtree);
+	LevelStatsTree prune(std::string const& path);
+
+	std::vector<double> averages() const;
+
+private:
+	TreeNode ** find_slot(std::string const& path);
+	void trim_empty_levels();
+
+	TreeNode * root_node = nullptr;
+
+	// levels_info[l].first = sum
+	// levels_info[l].second = count of nodes at level l
+	std::vector<std::pair<long, int> > levels_info;
+};
+
+/*
+ * The reducers of 'reduce_levels'. Each one holds the state of a single
+ * statistic of one level, and 'add' folds the value of a node into it.
+ */
+struct SumReducer
+{
+	long sum = 0;
+
+	void add(int val)
+	{
+		sum += val;
+	}
+};
+
+struct CountReducer
+{
+	int count = 0;
+
+	void add(int)
+	{
+		count++;
+	}
+};
+
+struct MinReducer
+{
+	int min = std::numeric_limits<int>::max();
+
+	void add(int val)
+	{
+		min = std::min(min, val);
+	}
+};
+
+struct MaxReducer
+{
+	int max = std::numeric_limits<int>::min();
+
+	void add(int val)
+	{
+		max = std::max(max, val);
+	}
+};
+
+/*
+ * Welford's online algorithm, which gets the mean and the (population)
+ * variance in one pass, without the cancellation of a sum of squares.
+ */
+struct VarianceReducer
+{
+	int count = 0;
+	double mean = 0.0;
+	double m2 = 0.0;
+
+	void add(int val)
+	{
+		count++;
+
+		double delta = val - mean;
+		mean += delta / count;
+		m2 += delta * (val - mean);
+	}
+
+	double variance() const
+	{
+		return count > 0 ? m2 / count : 0.0;
+	}
+};
+
+/*
+ * Counts the values of a level in 'NumBins' equal bins over [ Low, High ].
+ * The values outside of that range go to the first or the last bin.
+ */
+template <int Low, int High, std::size_t NumBins>
+struct HistogramReducer
+{
+	std::array<int, NumBins> bins {};
+
+	void add(int val)
+	{
+		long clamped = std::min(std::max(val, Low), High);
+		long bin = (clamped - Low) * static_cast<long>(NumBins) / (static_cast<long>(High) - Low + 1);
+
+		bins[bin]++;
+	}
+};
+
+template <typename... Reducers>
+std::vector<std::tuple<Reducers...> > reduce_levels(TreeNode * root);
+
+std::vector<double> average_of_levels_5(TreeNode * root);
+
+/*
+ * Splits a tree serialized in level order, like "[3,9,20,null,null,15,7]",
+ * into values and null markers. The input is read in chunks of
+ * 'chunk_size' bytes, so only one chunk is in memory at a time.
+ */
+class LevelOrderReader
+{
+public:
+	enum class Token
+	{
+		value,
+		null_marker,
+		end,
+		error
+	};
+
+	explicit LevelOrderReader(std::istream & in, std::size_t chunk_size = 1 << 16);
+
+	// Reads the next token. 'val' is only set for Token::value.
+	Token next(int & val);
+
+private:
+	int peek();
+	int get();
+
+	std::istream & in;
+	std::vector<char> buffer;
+	std::size_t position = 0;
+	std::size_t size = 0;
+};
+
+template <typename Emit>
+bool stream_average_of_levels(std::istream & in, Emit emit, std::size_t chunk_size = 1 << 16);
+
+std::string serialize_level_order(TreeNode * root);
+
+/*
+ * Yields the averages of a tree one level at a time, breadth-first.
+ * Between two levels, the only state kept is the frontier of the next
+ * level, so a caller can stop early, or resume later, without paying for
+ * the levels it has not asked for. The tree must not change in between.
+ */
+class LevelAverageGenerator
+{
+public:
+	explicit LevelAverageGenerator(TreeNode * root);
+
+	// Computes the average of the next level.
+	// Returns false once every level has been yielded.
+	bool next(double & average);
+
+	std::size_t num_levels_yielded() const
+	{
+		return num_levels;
+	}
+
+private:
+	std::vector<TreeNode*> frontier;
+	std::vector<TreeNode*> next_frontier;
+	std::size_t num_levels = 0;
+};
+
+/*
+ * Answers "what is the average of the nodes d levels below node v" on a
+ * tree that does not change.
+ *
+ * The nodes are numbered in preorder, so the subtree of v is the range
+ * [ v, subtree_end[v] ) of numbers. For each level, the index keeps the
+ * preorder numbers of its nodes, which come out sorted, and the prefix
+ * sums of their values. A query is then two binary searches in one level.
+ */
+class SubtreeLevelIndex
+{
+public:
+	struct Query
+	{
+		TreeNode const* node;
+		int depth;
+	};
+
+	struct MemoryFootprint
+	{
+		std::size_t node_numbers = 0;
+		std::size_t subtrees = 0;
+		std::size_t levels = 0;
+
+		std::size_t total() const
+		{
+			return node_numbers + subtrees + levels;
+		}
+	};
+
+	explicit SubtreeLevelIndex(TreeNode * root);
+
+	// Returns the average of the nodes 'depth' levels below 'node', where
+	// 0 is 'node' itself, or NaN if there are none or 'node' is not indexed.
+	double average(TreeNode const* node, int depth) const;
+
+	void average_batch(std::vector<Query> const& queries, std::vector<double> & averages) const;
+
+	MemoryFootprint memory_footprint() const;
+
+private:
+	std::unordered_map<TreeNode const*, int> node_numbers;
+	std::vector<int> subtree_end;
+	std::vector<int> node_level;
+	std::vector<std::vector<int> > level_numbers;
+	std::vector<std::vector<long> > level_prefix_sums;
+};
+
+TreeNode * make_chain_tree(std::size_t num_nodes);
+
+TreeNode * make_random_tree(std::size_t num_nodes, unsigned seed);
+
+void delete_tree(TreeNode * root);
+
+template <typename Function>
+double time_ms(Function function);
+
+void test_flat_tree();
+void benchmark_flat_tree();
+void test_parallel_levels();
+void benchmark_parallel_levels();
+void test_level_stats_tree();
+void test_reduce_levels();
+void benchmark_reduce_levels();
+void test_stream_average_of_levels();
+void benchmark_stream_average_of_levels();
+void test_level_average_generator();
+void benchmark_level_average_generator();
+void test_subtree_level_index();
+void benchmark_subtree_level_index();
+
 int main()
 {
 	TreeNode * root = new TreeNode(3);
@@ -73,6 +428,37 @@ int main()
 	avg = average_of_levels_2(root);
 	print(avg);
 
+	avg = average_of_levels_3(flatten_tree(root));
+	print(avg);
+
+	delete_tree(root);
+
+	test_flat_tree();
+
+	benchmark_flat_tree();
+
+	test_parallel_levels();
+
+	benchmark_parallel_levels();
+
+	test_level_stats_tree();
+
+	test_reduce_levels();
+
+	benchmark_reduce_levels();
+
+	test_stream_average_of_levels();
+
+	benchmark_stream_average_of_levels();
+
+	test_level_average_generator();
+
+	benchmark_level_average_generator();
+
+	test_subtree_level_index();
+
+	benchmark_subtree_level_index();
+
 	return 0;
 }
 
@@ -192,3 +578,1712 @@ std::vector<double> average_of_levels_2(TreeNode * root)
 
 	return averages;
 }
+
+/*
+ * Copies a tree into a FlatTree. The tree is walked breadth-first, and
+ * the vector of visited nodes doubles as the queue, so the children of
+ * a node get their index in 'values' as soon as they are enqueued.
+ */
+FlatTree flatten_tree(TreeNode * root)
+{
+	FlatTree tree;
+
+	if (root != nullptr)
+	{
+		std::vector<TreeNode*> order;
+		order.push_back(root);
+
+		tree.level_offsets.push_back(0);
+
+		std::size_t level_begin = 0;
+
+		while (level_begin < order.size())
+		{
+			std::size_t level_end = order.size();
+
+			for (std::size_t i = level_begin; i < level_end; i++)
+			{
+				TreeNode * node = order[i];
+
+				tree.values.push_back(node->val);
+
+				if (node->left != nullptr)
+				{
+					tree.left_child.push_back(static_cast<int>(order.size()));
+					order.push_back(node->left);
+				}
+				else
+				{
+					tree.left_child.push_back(-1);
+				}
+
+				if (node->right != nullptr)
+				{
+					tree.right_child.push_back(static_cast<int>(order.size()));
+					order.push_back(node->right);
+				}
+				else
+				{
+					tree.right_child.push_back(-1);
+				}
+			}
+
+			tree.level_offsets.push_back(level_end);
+			level_begin = level_end;
+		}
+	}
+
+	return tree;
+}
+
+/*
+ * This solution works on a FlatTree. Since each level is a contiguous
+ * range of 'values', the average of a level is a linear scan over that
+ * range, with no pointer chasing at all.
+ */
+std::vector<double> average_of_levels_3(FlatTree const& tree)
+{
+	std::vector<double> averages;
+	averages.reserve(tree.num_levels());
+
+	for (std::size_t level = 0; level < tree.num_levels(); level++)
+	{
+		std::size_t begin = tree.level_offsets[level];
+		std::size_t end = tree.level_offsets[level + 1];
+
+		long sum = 0;
+
+		for (std::size_t i = begin; i < end; i++)
+		{
+			sum += tree.values[i];
+		}
+
+		averages.push_back(sum / (static_cast<double>(end - begin)));
+	}
+
+	return averages;
+}
+
+void WorkStealingQueue::push(SubtreeTask const& task)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	tasks.push_back(task);
+	num_tasks.store(tasks.size(), std::memory_order_relaxed);
+}
+
+bool WorkStealingQueue::pop(SubtreeTask & task)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	if (tasks.empty())
+	{
+		return false;
+	}
+
+	task = tasks.back();
+	tasks.pop_back();
+	num_tasks.store(tasks.size(), std::memory_order_relaxed);
+
+	return true;
+}
+
+bool WorkStealingQueue::steal(SubtreeTask & task)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	if (tasks.empty())
+	{
+		return false;
+	}
+
+	task = tasks.front();
+	tasks.pop_front();
+	num_tasks.store(tasks.size(), std::memory_order_relaxed);
+
+	return true;
+}
+
+/*
+ * The body of one 'average_of_levels_4' worker.
+ *
+ * A task is walked depth-first with an explicit stack, so deep trees
+ * cannot overflow the call stack. The nodes are popped 'batch_size' at a
+ * time and prefetched when pushed, so the cache misses of a batch overlap
+ * instead of each child waiting on the load of its parent. The sums and
+ * counts go into the dense per-level 'partial' of this worker, indexed
+ * by level.
+ *
+ * The cutoff is adaptive: a subtree is only published for stealing when
+ * its parent has two children, some worker is idle, and the worker's own
+ * queue is nearly empty. A degenerate chain never splits, and a busy
+ * pool stops creating tasks altogether.
+ */
+void average_of_levels_worker(
+	std::size_t self,
+	std::vector<std::unique_ptr<WorkStealingQueue> > & queues,
+	std::atomic<long> & pending_tasks,
+	std::atomic<int> & idle_workers,
+	std::vector<std::pair<long, int> > & partial)
+{
+	std::size_t const max_published_tasks = 2;
+	std::size_t const batch_size = 16;
+
+	WorkStealingQueue & own_queue = *queues[self];
+
+	std::mt19937 generator(static_cast<unsigned>(self));
+	std::uniform_int_distribution<std::size_t> victim_distribution(0, queues.size() - 1);
+
+	std::vector<SubtreeTask> stack;
+	SubtreeTask batch[batch_size];
+
+	bool idle = false;
+
+	while (true)
+	{
+		SubtreeTask task;
+
+		bool found = own_queue.pop(task);
+
+		// Try a round of random victims before checking for termination.
+		for (std::size_t attempt = 0; !found && attempt < queues.size(); attempt++)
+		{
+			std::size_t victim = victim_distribution(generator);
+
+			if (victim != self)
+			{
+				found = queues[victim]->steal(task);
+			}
+		}
+
+		if (!found)
+		{
+			if (!idle)
+			{
+				idle = true;
+				idle_workers++;
+			}
+
+			if (pending_tasks.load() == 0)
+			{
+				return;
+			}
+
+			std::this_thread::yield();
+			continue;
+		}
+
+		if (idle)
+		{
+			idle = false;
+			idle_workers--;
+		}
+
+		stack.push_back(task);
+
+		while (!stack.empty())
+		{
+			std::size_t num_batched = std::min(stack.size(), batch_size);
+
+			std::copy(stack.end() - num_batched, stack.end(), batch);
+			stack.resize(stack.size() - num_batched);
+
+			for (std::size_t i = 0; i < num_batched; i++)
+			{
+				SubtreeTask const& current = batch[i];
+
+				if (partial.size() <= static_cast<std::size_t>(current.level))
+				{
+					partial.resize(current.level + 1);
+				}
+
+				std::pair<long, int> & p = partial[current.level];
+				p.first += current.node->val;
+				p.second++;
+
+				TreeNode * left = current.node->left;
+				TreeNode * right = current.node->right;
+
+				if (left != nullptr
+					&& right != nullptr
+					&& idle_workers.load(std::memory_order_relaxed) > 0
+					&& own_queue.size() < max_published_tasks)
+				{
+					pending_tasks++;
+					own_queue.push({ right, current.level + 1 });
+
+					right = nullptr;
+				}
+
+				if (right != nullptr)
+				{
+					__builtin_prefetch(right);
+					stack.push_back({ right, current.level + 1 });
+				}
+
+				if (left != nullptr)
+				{
+					__builtin_prefetch(left);
+					stack.push_back({ left, current.level + 1 });
+				}
+			}
+		}
+
+		pending_tasks--;
+	}
+}
+
+/*
+ * This solution splits the tree across a pool of work-stealing workers.
+ * Each worker builds its own dense per-level (sum, count) partial, and
+ * the partials are added together once every worker is done.
+ */
+std::vector<double> average_of_levels_4(TreeNode * root, unsigned num_threads)
+{
+	std::vector<double> averages;
+
+	if (root != nullptr)
+	{
+		if (num_threads == 0)
+		{
+			num_threads = 1;
+		}
+
+		std::vector<std::unique_ptr<WorkStealingQueue> > queues;
+
+		for (unsigned i = 0; i < num_threads; i++)
+		{
+			queues.emplace_back(new WorkStealingQueue());
+		}
+
+		std::vector<std::vector<std::pair<long, int> > > partials(num_threads);
+
+		std::atomic<long> pending_tasks(1);
+		std::atomic<int> idle_workers(0);
+		queues[0]->push({ root, 0 });
+
+		std::vector<std::thread> threads;
+
+		for (unsigned i = 1; i < num_threads; i++)
+		{
+			threads.emplace_back(
+				average_of_levels_worker,
+				i,
+				std::ref(queues),
+				std::ref(pending_tasks),
+				std::ref(idle_workers),
+				std::ref(partials[i]));
+		}
+
+		average_of_levels_worker(0, queues, pending_tasks, idle_workers, partials[0]);
+
+		for (std::thread & thread : threads)
+		{
+			thread.join();
+		}
+
+		std::vector<std::pair<long, int> > levels_info;
+
+		for (std::vector<std::pair<long, int> > const& partial : partials)
+		{
+			if (levels_info.size() < partial.size())
+			{
+				levels_info.resize(partial.size());
+			}
+
+			for (std::size_t level = 0; level < partial.size(); level++)
+			{
+				levels_info[level].first += partial[level].first;
+				levels_info[level].second += partial[level].second;
+			}
+		}
+
+		for (std::pair<long, int> const& p : levels_info)
+		{
+			averages.push_back(p.first / (static_cast<double>(p.second)));
+		}
+	}
+
+	return averages;
+}
+
+LevelStatsTree::LevelStatsTree(TreeNode * root)
+	: root_node(root)
+{
+	std::vector<std::pair<TreeNode*, int> > stack;
+
+	if (root != nullptr)
+	{
+		stack.push_back({ root, 0 });
+	}
+
+	while (!stack.empty())
+	{
+		TreeNode * node = stack.back().first;
+		int level = stack.back().second;
+		stack.pop_back();
+
+		if (levels_info.size() <= static_cast<std::size_t>(level))
+		{
+			levels_info.resize(level + 1);
+		}
+
+		levels_info[level].first += node->val;
+		levels_info[level].second++;
+
+		if (node->left != nullptr)
+		{
+			stack.push_back({ node->left, level + 1 });
+		}
+
+		if (node->right != nullptr)
+		{
+			stack.push_back({ node->right, level + 1 });
+		}
+	}
+}
+
+LevelStatsTree::LevelStatsTree(LevelStatsTree && other)
+	: root_node(other.root_node),
+	  levels_info(std::move(other.levels_info))
+{
+	other.root_node = nullptr;
+	other.levels_info.clear();
+}
+
+LevelStatsTree & LevelStatsTree::operator=(LevelStatsTree && other)
+{
+	if (this != &other)
+	{
+		delete_tree(root_node);
+
+		root_node = other.root_node;
+		levels_info = std::move(other.levels_info);
+
+		other.root_node = nullptr;
+		other.levels_info.clear();
+	}
+
+	return *this;
+}
+
+LevelStatsTree::~LevelStatsTree()
+{
+	delete_tree(root_node);
+}
+
+/*
+ * Returns the address of the child pointer that 'path' names, which is
+ * null when there is no node there yet. Returns nullptr when the parent
+ * of 'path' does not exist, or when 'path' is malformed.
+ */
+TreeNode ** LevelStatsTree::find_slot(std::string const& path)
+{
+	TreeNode ** slot = &root_node;
+
+	for (char const& direction : path)
+	{
+		if (*slot == nullptr)
+		{
+			return nullptr;
+		}
+
+		if (direction == 'L')
+		{
+			slot = &(*slot)->left;
+		}
+		else if (direction == 'R')
+		{
+			slot = &(*slot)->right;
+		}
+		else
+		{
+			return nullptr;
+		}
+	}
+
+	return slot;
+}
+
+/*
+ * Drops the deepest levels once they have no nodes left.
+ */
+void LevelStatsTree::trim_empty_levels()
+{
+	while (!levels_info.empty() && levels_info.back().second == 0)
+	{
+		levels_info.pop_back();
+	}
+}
+
+bool LevelStatsTree::insert_leaf(std::string const& path, int val)
+{
+	TreeNode ** slot = find_slot(path);
+
+	if (slot == nullptr || *slot != nullptr)
+	{
+		return false;
+	}
+
+	*slot = new TreeNode(val);
+
+	if (levels_info.size() <= path.size())
+	{
+		levels_info.resize(path.size() + 1);
+	}
+
+	levels_info[path.size()].first += val;
+	levels_info[path.size()].second++;
+
+	return true;
+}
+
+bool LevelStatsTree::delete_leaf(std::string const& path)
+{
+	TreeNode ** slot = find_slot(path);
+
+	if (slot == nullptr || *slot == nullptr || (*slot)->left != nullptr || (*slot)->right != nullptr)
+	{
+		return false;
+	}
+
+	levels_info[path.size()].first -= (*slot)->val;
+	levels_info[path.size()].second--;
+
+	delete *slot;
+	*slot = nullptr;
+
+	trim_empty_levels();
+
+	return true;
+}
+
+bool LevelStatsTree::update_value(std::string const& path, int val)
+{
+	TreeNode ** slot = find_slot(path);
+
+	if (slot == nullptr || *slot == nullptr)
+	{
+		return false;
+	}
+
+	levels_info[path.size()].first += static_cast<long>(val) - (*slot)->val;
+	(*slot)->val = val;
+
+	return true;
+}
+
+bool LevelStatsTree::graft(std::string const& path, LevelStatsTree && subtree)
+{
+	TreeNode ** slot = find_slot(path);
+
+	if (slot == nullptr || *slot != nullptr || subtree.root_node == nullptr)
+	{
+		return false;
+	}
+
+	*slot = subtree.root_node;
+
+	if (levels_info.size() < path.size() + subtree.levels_info.size())
+	{
+		levels_info.resize(path.size() + subtree.levels_info.size());
+	}
+
+	for (std::size_t level = 0; level < subtree.levels_info.size(); level++)
+	{
+		levels_info[path.size() + level].first += subtree.levels_info[level].first;
+		levels_info[path.size() + level].second += subtree.levels_info[level].second;
+	}
+
+	subtree.root_node = nullptr;
+	subtree.levels_info.clear();
+
+	return true;
+}
+
+/*
+ * Detaches the subtree at 'path' and returns it as a tree of its own.
+ * Returns an empty tree when there is no node at 'path'.
+ */
+LevelStatsTree LevelStatsTree::prune(std::string const& path)
+{
+	TreeNode ** slot = find_slot(path);
+
+	if (slot == nullptr || *slot == nullptr)
+	{
+		return LevelStatsTree();
+	}
+
+	LevelStatsTree subtree(*slot);
+	*slot = nullptr;
+
+	for (std::size_t level = 0; level < subtree.levels_info.size(); level++)
+	{
+		levels_info[path.size() + level].first -= subtree.levels_info[level].first;
+		levels_info[path.size() + level].second -= subtree.levels_info[level].second;
+	}
+
+	trim_empty_levels();
+
+	return subtree;
+}
+
+std::vector<double> LevelStatsTree::averages() const
+{
+	std::vector<double> averages;
+	averages.reserve(levels_info.size());
+
+	for (std::pair<long, int> const& p : levels_info)
+	{
+		averages.push_back(p.first / (static_cast<double>(p.second)));
+	}
+
+	return averages;
+}
+
+/*
+ * Folds a node value into each reducer of a level, in order.
+ */
+template <typename Tuple, std::size_t... Indices>
+void add_to_reducers(Tuple & reducers, int val, std::index_sequence<Indices...>)
+{
+	int expand[] = { 0, (std::get<Indices>(reducers).add(val), 0)... };
+	(void)expand;
+}
+
+/*
+ * Computes every statistic in 'Reducers' for each level of the tree, in
+ * a single breadth-first traversal. The levels are dense integers, so
+ * their states live in a vector indexed by level, and a statistic that
+ * is not in 'Reducers' is not computed at all. For example,
+ *
+ *	reduce_levels<MinReducer, MaxReducer>(root)[2]
+ *
+ * is the tuple of the min and max reducers of level 2.
+ */
+template <typename... Reducers>
+std::vector<std::tuple<Reducers...> > reduce_levels(TreeNode * root)
+{
+	std::vector<std::tuple<Reducers...> > levels;
+
+	std::vector<TreeNode*> current_level;
+	std::vector<TreeNode*> next_level;
+
+	if (root != nullptr)
+	{
+		current_level.push_back(root);
+	}
+
+	while (!current_level.empty())
+	{
+		levels.emplace_back();
+		std::tuple<Reducers...> & reducers = levels.back();
+
+		for (TreeNode * node : current_level)
+		{
+			add_to_reducers(reducers, node->val, std::index_sequence_for<Reducers...>());
+
+			if (node->left != nullptr)
+			{
+				next_level.push_back(node->left);
+			}
+
+			if (node->right != nullptr)
+			{
+				next_level.push_back(node->right);
+			}
+		}
+
+		current_level.swap(next_level);
+		next_level.clear();
+	}
+
+	return levels;
+}
+
+/*
+ * This solution gets the sum and the count of each level from
+ * 'reduce_levels', instead of the unordered_map of 'average_of_levels_2'.
+ */
+std::vector<double> average_of_levels_5(TreeNode * root)
+{
+	std::vector<std::tuple<SumReducer, CountReducer> > levels = reduce_levels<SumReducer, CountReducer>(root);
+
+	std::vector<double> averages;
+	averages.reserve(levels.size());
+
+	for (std::tuple<SumReducer, CountReducer> const& reducers : levels)
+	{
+		averages.push_back(std::get<0>(reducers).sum / (static_cast<double>(std::get<1>(reducers).count)));
+	}
+
+	return averages;
+}
+
+LevelOrderReader::LevelOrderReader(std::istream & in, std::size_t chunk_size)
+	: in(in),
+	  buffer(std::max<std::size_t>(chunk_size, 1))
+{
+}
+
+int LevelOrderReader::peek()
+{
+	if (position == size)
+	{
+		in.read(buffer.data(), buffer.size());
+
+		size = static_cast<std::size_t>(in.gcount());
+		position = 0;
+
+		if (size == 0)
+		{
+			return std::char_traits<char>::eof();
+		}
+	}
+
+	return static_cast<unsigned char>(buffer[position]);
+}
+
+int LevelOrderReader::get()
+{
+	int c = peek();
+
+	if (c != std::char_traits<char>::eof())
+	{
+		position++;
+	}
+
+	return c;
+}
+
+LevelOrderReader::Token LevelOrderReader::next(int & val)
+{
+	int c = peek();
+
+	// Skip the brackets, the commas and the white space between tokens.
+	while (c == '[' || c == ']' || c == ',' || c == ' ' || c == '\t' || c == '\n' || c == '\r')
+	{
+		get();
+		c = peek();
+	}
+
+	if (c == std::char_traits<char>::eof())
+	{
+		return Token::end;
+	}
+
+	if (c == 'n')
+	{
+		for (char const& expected : std::string("null"))
+		{
+			if (get() != expected)
+			{
+				return Token::error;
+			}
+		}
+
+		return Token::null_marker;
+	}
+
+	bool negative = (c == '-');
+
+	if (negative)
+	{
+		get();
+		c = peek();
+	}
+
+	if (c < '0' || c > '9')
+	{
+		return Token::error;
+	}
+
+	long magnitude = 0;
+
+	while (c >= '0' && c <= '9')
+	{
+		magnitude = magnitude * 10 + (get() - '0');
+
+		if (magnitude > 1L + std::numeric_limits<int>::max())
+		{
+			return Token::error;
+		}
+
+		c = peek();
+	}
+
+	long value = negative ? -magnitude : magnitude;
+
+	if (value > std::numeric_limits<int>::max())
+	{
+		return Token::error;
+	}
+
+	val = static_cast<int>(value);
+
+	return Token::value;
+}
+
+/*
+ * This solution never builds the tree. In level order, each level has
+ * two slots, a value or a null marker, per node of the level above it,
+ * and the trailing null markers may be left out. So it is enough to
+ * count the non-null values of a level to know how many tokens make up
+ * the next one, and a level is complete, and its average is passed to
+ * 'emit', as soon as that many tokens have been read.
+ *
+ * The memory used is one chunk of input plus a few counters, whatever
+ * the size or width of the tree. Returns false on malformed input, after
+ * the levels before the error have been emitted.
+ */
+template <typename Emit>
+bool stream_average_of_levels(std::istream & in, Emit emit, std::size_t chunk_size)
+{
+	LevelOrderReader reader(in, chunk_size);
+	LevelOrderReader::Token token = LevelOrderReader::Token::value;
+
+	int val = 0;
+	std::size_t num_slots = 1;
+
+	while (num_slots > 0 && token != LevelOrderReader::Token::end)
+	{
+		long sum = 0;
+		std::size_t num_values = 0;
+
+		for (std::size_t i = 0; i < num_slots; i++)
+		{
+			token = reader.next(val);
+
+			if (token == LevelOrderReader::Token::error)
+			{
+				return false;
+			}
+
+			if (token == LevelOrderReader::Token::end)
+			{
+				break;
+			}
+
+			if (token == LevelOrderReader::Token::value)
+			{
+				sum += val;
+				num_values++;
+			}
+		}
+
+		if (num_values > 0)
+		{
+			emit(sum / (static_cast<double>(num_values)));
+		}
+
+		num_slots = 2 * num_values;
+	}
+
+	// Only null markers may follow the last level.
+	while (token != LevelOrderReader::Token::end)
+	{
+		token = reader.next(val);
+
+		if (token == LevelOrderReader::Token::value || token == LevelOrderReader::Token::error)
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+/*
+ * Serializes a tree in level order, without the trailing null markers.
+ */
+std::string serialize_level_order(TreeNode * root)
+{
+	std::ostringstream out;
+	out << "[";
+
+	std::vector<TreeNode*> slots;
+	slots.push_back(root);
+
+	std::size_t num_pending_nulls = 0;
+	bool first = true;
+
+	for (std::size_t i = 0; i < slots.size(); i++)
+	{
+		if (slots[i] == nullptr)
+		{
+			num_pending_nulls++;
+			continue;
+		}
+
+		// A null marker is never the first token, since the root comes first.
+		for (; num_pending_nulls > 0; num_pending_nulls--)
+		{
+			out << ",null";
+		}
+
+		out << (first ? "" : ",") << slots[i]->val;
+		first = false;
+
+		slots.push_back(slots[i]->left);
+		slots.push_back(slots[i]->right);
+	}
+
+	out << "]";
+
+	return out.str();
+}
+
+LevelAverageGenerator::LevelAverageGenerator(TreeNode * root)
+{
+	if (root != nullptr)
+	{
+		frontier.push_back(root);
+	}
+}
+
+bool LevelAverageGenerator::next(double & average)
+{
+	if (frontier.empty())
+	{
+		return false;
+	}
+
+	long sum = 0;
+
+	for (TreeNode * node : frontier)
+	{
+		sum += node->val;
+
+		if (node->left != nullptr)
+		{
+			next_frontier.push_back(node->left);
+		}
+
+		if (node->right != nullptr)
+		{
+			next_frontier.push_back(node->right);
+		}
+	}
+
+	average = sum / (static_cast<double>(frontier.size()));
+
+	frontier.swap(next_frontier);
+	next_frontier.clear();
+
+	num_levels++;
+
+	return true;
+}
+
+SubtreeLevelIndex::SubtreeLevelIndex(TreeNode * root)
+{
+	std::vector<int> parent;
+	std::vector<std::pair<TreeNode*, int> > stack;
+
+	if (root != nullptr)
+	{
+		stack.push_back({ root, -1 });
+	}
+
+	// Number the nodes in preorder. The right child is pushed first so
+	// that the left subtree gets the lower numbers.
+	while (!stack.empty())
+	{
+		TreeNode * node = stack.back().first;
+		int parent_number = stack.back().second;
+		stack.pop_back();
+
+		int number = static_cast<int>(parent.size());
+		int level = (parent_number < 0) ? 0 : node_level[parent_number] + 1;
+
+		node_numbers[node] = number;
+		parent.push_back(parent_number);
+		node_level.push_back(level);
+
+		if (level_numbers.size() <= static_cast<std::size_t>(level))
+		{
+			level_numbers.resize(level + 1);
+			level_prefix_sums.resize(level + 1, std::vector<long>(1, 0));
+		}
+
+		level_numbers[level].push_back(number);
+		level_prefix_sums[level].push_back(level_prefix_sums[level].back() + node->val);
+
+		if (node->right != nullptr)
+		{
+			stack.push_back({ node->right, number });
+		}
+
+		if (node->left != nullptr)
+		{
+			stack.push_back({ node->left, number });
+		}
+	}
+
+	// A node is numbered before its descendants, so walking the numbers
+	// backwards sees every subtree size complete before its parent's.
+	std::vector<int> subtree_size(parent.size(), 1);
+
+	for (std::size_t number = parent.size(); number-- > 1; )
+	{
+		subtree_size[parent[number]] += subtree_size[number];
+	}
+
+	subtree_end.resize(parent.size());
+
+	for (std::size_t number = 0; number < parent.size(); number++)
+	{
+		subtree_end[number] = static_cast<int>(number) + subtree_size[number];
+	}
+}
+
+double SubtreeLevelIndex::average(TreeNode const* node, int depth) const
+{
+	std::unordered_map<TreeNode const*, int>::const_iterator it = node_numbers.find(node);
+
+	if (it == node_numbers.end() || depth < 0)
+	{
+		return std::numeric_limits<double>::quiet_NaN();
+	}
+
+	int number = it->second;
+	std::size_t level = static_cast<std::size_t>(node_level[number]) + depth;
+
+	if (level >= level_numbers.size())
+	{
+		return std::numeric_limits<double>::quiet_NaN();
+	}
+
+	std::vector<int> const& numbers = level_numbers[level];
+
+	std::size_t begin = std::lower_bound(numbers.begin(), numbers.end(), number) - numbers.begin();
+	std::size_t end = std::lower_bound(numbers.begin() + begin, numbers.end(), subtree_end[number]) - numbers.begin();
+
+	if (begin == end)
+	{
+		return std::numeric_limits<double>::quiet_NaN();
+	}
+
+	long sum = level_prefix_sums[level][end] - level_prefix_sums[level][begin];
+
+	return sum / (static_cast<double>(end - begin));
+}
+
+void SubtreeLevelIndex::average_batch(std::vector<Query> const& queries, std::vector<double> & averages) const
+{
+	averages.resize(queries.size());
+
+	for (std::size_t i = 0; i < queries.size(); i++)
+	{
+		averages[i] = average(queries[i].node, queries[i].depth);
+	}
+}
+
+/*
+ * The memory held by the index, in bytes. The size of the hash map is
+ * an estimate: one bucket pointer per bucket, and one heap node, with
+ * its key, value and next pointer, per entry.
+ */
+SubtreeLevelIndex::MemoryFootprint SubtreeLevelIndex::memory_footprint() const
+{
+	MemoryFootprint footprint;
+
+	footprint.node_numbers = node_numbers.bucket_count() * sizeof(void*)
+		+ node_numbers.size() * (sizeof(void*) + sizeof(std::pair<TreeNode const*, int>));
+
+	footprint.subtrees = (subtree_end.capacity() + node_level.capacity()) * sizeof(int);
+
+	footprint.levels = (level_numbers.capacity() + level_prefix_sums.capacity()) * sizeof(std::vector<int>);
+
+	for (std::size_t level = 0; level < level_numbers.size(); level++)
+	{
+		footprint.levels += level_numbers[level].capacity() * sizeof(int)
+			+ level_prefix_sums[level].capacity() * sizeof(long);
+	}
+
+	return footprint;
+}
+
+/*
+ * Builds a degenerate tree: a chain of 'num_nodes' nodes, each one the
+ * left child of the previous one.
+ */
+TreeNode * make_chain_tree(std::size_t num_nodes)
+{
+	TreeNode * root = nullptr;
+
+	for (std::size_t i = 0; i < num_nodes; i++)
+	{
+		TreeNode * node = new TreeNode(static_cast<int>(num_nodes - i));
+		node->left = root;
+		root = node;
+	}
+
+	return root;
+}
+
+/*
+ * Builds a random tree of 'num_nodes' nodes. Each node is attached to a
+ * randomly chosen free child slot of the nodes already in the tree.
+ * The nodes are linked in a shuffled order, so neighbouring nodes of the
+ * tree are scattered over the heap like in a long-lived tree.
+ */
+TreeNode * make_random_tree(std::size_t num_nodes, unsigned seed)
+{
+	if (num_nodes == 0)
+	{
+		return nullptr;
+	}
+
+	std::mt19937 generator(seed);
+	std::uniform_int_distribution<int> value_distribution(-1000000, 1000000);
+
+	std::vector<TreeNode*> nodes;
+	nodes.reserve(num_nodes);
+
+	for (std::size_t i = 0; i < num_nodes; i++)
+	{
+		nodes.push_back(new TreeNode(value_distribution(generator)));
+	}
+
+	std::shuffle(nodes.begin(), nodes.end(), generator);
+
+	// Each free slot is the address of a null child pointer.
+	std::vector<TreeNode**> free_slots;
+	free_slots.push_back(&nodes[0]->left);
+	free_slots.push_back(&nodes[0]->right);
+
+	for (std::size_t i = 1; i < num_nodes; i++)
+	{
+		std::uniform_int_distribution<std::size_t> slot_distribution(0, free_slots.size() - 1);
+		std::size_t slot = slot_distribution(generator);
+
+		*free_slots[slot] = nodes[i];
+
+		free_slots[slot] = free_slots.back();
+		free_slots.pop_back();
+
+		free_slots.push_back(&nodes[i]->left);
+		free_slots.push_back(&nodes[i]->right);
+	}
+
+	return nodes[0];
+}
+
+/*
+ * Deletes every node of a tree. This is iterative, so it also works on
+ * trees that are too deep to be deleted recursively.
+ */
+void delete_tree(TreeNode * root)
+{
+	std::vector<TreeNode*> stack;
+
+	if (root != nullptr)
+	{
+		stack.push_back(root);
+	}
+
+	while (!stack.empty())
+	{
+		TreeNode * node = stack.back();
+		stack.pop_back();
+
+		if (node->left != nullptr)
+		{
+			stack.push_back(node->left);
+		}
+
+		if (node->right != nullptr)
+		{
+			stack.push_back(node->right);
+		}
+
+		delete node;
+	}
+}
+
+template <typename Function>
+double time_ms(Function function)
+{
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	function();
+
+	std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+
+	return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+void test_flat_tree()
+{
+	for (unsigned seed = 0; seed < 20; seed++)
+	{
+		TreeNode * root = make_random_tree(seed * 37, seed);
+
+		bool same = (average_of_levels_3(flatten_tree(root)) == average_of_levels_1(root));
+
+		delete_tree(root);
+
+		if (!same)
+		{
+			std::cout << "test_flat_tree failed for seed " << seed << std::endl;
+			return;
+		}
+	}
+
+	std::cout << "test_flat_tree passed" << std::endl;
+}
+
+void benchmark_flat_tree()
+{
+	std::size_t const num_nodes = 1 << 21;
+
+	TreeNode * root = make_random_tree(num_nodes, 42);
+
+	std::vector<double> avg_1;
+	std::vector<double> avg_2;
+	std::vector<double> avg_3;
+	FlatTree tree;
+
+	double ms_1 = time_ms([&]() { avg_1 = average_of_levels_1(root); });
+	double ms_2 = time_ms([&]() { avg_2 = average_of_levels_2(root); });
+	double ms_flatten = time_ms([&]() { tree = flatten_tree(root); });
+	double ms_3 = time_ms([&]() { avg_3 = average_of_levels_3(tree); });
+
+	std::cout << std::setprecision(2);
+	std::cout << "benchmark_flat_tree (" << num_nodes << " nodes, " << tree.num_levels() << " levels)" << std::endl;
+	std::cout << "\taverage_of_levels_1 : " << ms_1 << " ms" << std::endl;
+	std::cout << "\taverage_of_levels_2 : " << ms_2 << " ms" << std::endl;
+	std::cout << "\tflatten_tree        : " << ms_flatten << " ms (one-off)" << std::endl;
+	std::cout << "\taverage_of_levels_3 : " << ms_3 << " ms" << std::endl;
+	std::cout << "\tresults match       : " << (avg_1 == avg_3 && avg_2 == avg_3) << std::endl;
+
+	delete_tree(root);
+}
+
+void test_parallel_levels()
+{
+	for (unsigned seed = 0; seed < 20; seed++)
+	{
+		TreeNode * root = make_random_tree(seed * 1000, seed);
+
+		bool same = (average_of_levels_4(root, 1 + seed % 4) == average_of_levels_1(root));
+
+		delete_tree(root);
+
+		if (!same)
+		{
+			std::cout << "test_parallel_levels failed for seed " << seed << std::endl;
+			return;
+		}
+	}
+
+	// A chain this deep overflows the stack of 'average_of_levels_2'.
+	TreeNode * chain = make_chain_tree(1000000);
+
+	bool same = (average_of_levels_4(chain, 4) == average_of_levels_1(chain));
+
+	delete_tree(chain);
+
+	if (!same)
+	{
+		std::cout << "test_parallel_levels failed on a chain" << std::endl;
+		return;
+	}
+
+	std::cout << "test_parallel_levels passed" << std::endl;
+}
+
+void benchmark_parallel_levels()
+{
+	std::size_t const num_nodes = 1 << 22;
+
+	TreeNode * root = make_random_tree(num_nodes, 7);
+
+	std::vector<double> expected = average_of_levels_1(root);
+
+	std::cout << std::setprecision(2);
+	std::cout << "benchmark_parallel_levels (" << num_nodes << " nodes)" << std::endl;
+	std::cout << "\taverage_of_levels_1 : " << time_ms([&]() { average_of_levels_1(root); }) << " ms" << std::endl;
+
+	unsigned max_threads = std::max(4u, std::thread::hardware_concurrency());
+
+	for (unsigned num_threads = 1; num_threads <= max_threads; num_threads *= 2)
+	{
+		std::vector<double> averages;
+
+		double ms = time_ms([&]() { averages = average_of_levels_4(root, num_threads); });
+
+		std::cout << "\taverage_of_levels_4 (" << num_threads << " threads) : " << ms << " ms"
+			<< (averages == expected ? "" : " MISMATCH") << std::endl;
+	}
+
+	delete_tree(root);
+}
+
+/*
+ * Walks down from the root of 'tree' in random directions, and returns
+ * the path of the first empty slot it reaches.
+ */
+std::string random_free_path(LevelStatsTree const& tree, std::mt19937 & generator)
+{
+	std::string path;
+	TreeNode * node = tree.root();
+
+	while (node != nullptr)
+	{
+		bool go_left = (generator() % 2 == 0);
+
+		path += go_left ? 'L' : 'R';
+		node = go_left ? node->left : node->right;
+	}
+
+	return path;
+}
+
+/*
+ * Walks down from the root of 'tree' in random directions, and returns
+ * the path of a node it passes by. With 'leaf' set, it only stops at a leaf.
+ * 'tree' must not be empty.
+ */
+std::string random_node_path(LevelStatsTree const& tree, std::mt19937 & generator, bool leaf)
+{
+	std::string path;
+	TreeNode * node = tree.root();
+
+	while (node->left != nullptr || node->right != nullptr)
+	{
+		if (!leaf && generator() % 4 == 0)
+		{
+			break;
+		}
+
+		bool go_left = (node->right == nullptr) || (node->left != nullptr && generator() % 2 == 0);
+
+		path += go_left ? 'L' : 'R';
+		node = go_left ? node->left : node->right;
+	}
+
+	return path;
+}
+
+void test_level_stats_tree()
+{
+	std::mt19937 generator(2024);
+	std::uniform_int_distribution<int> value_distribution(-1000000, 1000000);
+
+	LevelStatsTree tree(make_random_tree(100, 1));
+
+	for (int step = 0; step < 20000; step++)
+	{
+		unsigned operation = generator() % 6;
+
+		if (tree.root() == nullptr)
+		{
+			operation = 0;
+		}
+
+		bool done = false;
+
+		switch (operation)
+		{
+		case 0:
+		case 1:
+			done = tree.insert_leaf(random_free_path(tree, generator), value_distribution(generator));
+			break;
+		case 2:
+			done = tree.delete_leaf(random_node_path(tree, generator, true));
+			break;
+		case 3:
+			done = tree.update_value(random_node_path(tree, generator, false), value_distribution(generator));
+			break;
+		case 4:
+			done = tree.graft(random_free_path(tree, generator), LevelStatsTree(make_random_tree(generator() % 20, step)));
+			break;
+		default:
+			// Prune a subtree, and sometimes graft it back somewhere else.
+			LevelStatsTree subtree = tree.prune(random_node_path(tree, generator, false));
+			done = (subtree.root() != nullptr);
+
+			if (generator() % 2 == 0)
+			{
+				tree.graft(random_free_path(tree, generator), std::move(subtree));
+			}
+			break;
+		}
+
+		if (tree.averages() != average_of_levels_1(tree.root()))
+		{
+			std::cout << "test_level_stats_tree failed at step " << step
+				<< " (operation " << operation << ", applied " << done << ")" << std::endl;
+			return;
+		}
+	}
+
+	// Edits that do not fit the tree must be rejected.
+	bool rejected = !tree.insert_leaf("", 1) && !tree.update_value("LX", 1) && !tree.prune("Q").root();
+
+	std::cout << "test_level_stats_tree " << (rejected ? "passed" : "failed") << std::endl;
+}
+
+void test_reduce_levels()
+{
+	typedef HistogramReducer<-1000000, 1000000, 8> Histogram;
+
+	for (unsigned seed = 0; seed < 20; seed++)
+	{
+		TreeNode * root = make_random_tree(seed * 500, seed);
+
+		std::vector<std::tuple<CountReducer, MinReducer, MaxReducer, VarianceReducer, Histogram> > levels =
+			reduce_levels<CountReducer, MinReducer, MaxReducer, VarianceReducer, Histogram>(root);
+
+		bool passed = (average_of_levels_5(root) == average_of_levels_1(root));
+
+		// Check each level against the plain values of that level.
+		FlatTree tree = flatten_tree(root);
+		passed = passed && (levels.size() == tree.num_levels());
+
+		for (std::size_t level = 0; passed && level < levels.size(); level++)
+		{
+			std::vector<int>::const_iterator begin = tree.values.begin() + tree.level_offsets[level];
+			std::vector<int>::const_iterator end = tree.values.begin() + tree.level_offsets[level + 1];
+
+			double mean = 0.0;
+
+			for (std::vector<int>::const_iterator it = begin; it != end; ++it)
+			{
+				mean += *it;
+			}
+
+			mean /= (end - begin);
+
+			double variance = 0.0;
+
+			for (std::vector<int>::const_iterator it = begin; it != end; ++it)
+			{
+				variance += (*it - mean) * (*it - mean);
+			}
+
+			variance /= (end - begin);
+
+			// Bin k holds the values from the first one whose bin formula
+			// reaches k, low + ceil(k * width / bins), up to the next such
+			// edge. Counted per bin from those edges, not with 'add'.
+			Histogram const& histogram = std::get<4>(levels[level]);
+			long const width = 2000001;
+			long const num_bins = static_cast<long>(histogram.bins.size());
+			bool bins_match = true;
+
+			for (long bin = 0; bin < num_bins; bin++)
+			{
+				long first = -1000000 + (bin * width + num_bins - 1) / num_bins;
+				long last = -1000000 + ((bin + 1) * width + num_bins - 1) / num_bins;
+
+				long expected = std::count_if(begin, end, [&](int val) { return val >= first && val < last; });
+
+				bins_match = bins_match && (histogram.bins[bin] == expected);
+			}
+
+			passed = (std::get<0>(levels[level]).count == end - begin)
+				&& (std::get<1>(levels[level]).min == *std::min_element(begin, end))
+				&& (std::get<2>(levels[level]).max == *std::max_element(begin, end))
+				&& (std::fabs(std::get<3>(levels[level]).variance() - variance) <= 1e-6 * (1.0 + variance))
+				&& bins_match;
+		}
+
+		delete_tree(root);
+
+		if (!passed)
+		{
+			std::cout << "test_reduce_levels failed for seed " << seed << std::endl;
+			return;
+		}
+	}
+
+	std::cout << "test_reduce_levels passed" << std::endl;
+}
+
+void benchmark_reduce_levels()
+{
+	std::size_t const num_nodes = 1 << 21;
+
+	TreeNode * root = make_random_tree(num_nodes, 11);
+
+	// What callers did before: one traversal per statistic.
+	double ms_separate = time_ms([&]() {
+		average_of_levels_2(root);
+		reduce_levels<MinReducer, MaxReducer>(root);
+		reduce_levels<VarianceReducer>(root);
+	});
+
+	double ms_single = time_ms([&]() {
+		reduce_levels<SumReducer, CountReducer, MinReducer, MaxReducer, VarianceReducer>(root);
+	});
+
+	std::cout << std::setprecision(2);
+	std::cout << "benchmark_reduce_levels (" << num_nodes << " nodes)" << std::endl;
+	std::cout << "\taverage_of_levels_2 : " << time_ms([&]() { average_of_levels_2(root); }) << " ms" << std::endl;
+	std::cout << "\taverage_of_levels_5 : " << time_ms([&]() { average_of_levels_5(root); }) << " ms" << std::endl;
+	std::cout << "\tthree traversals    : " << ms_separate << " ms" << std::endl;
+	std::cout << "\tone reduce_levels   : " << ms_single << " ms" << std::endl;
+
+	delete_tree(root);
+}
+
+void test_stream_average_of_levels()
+{
+	for (unsigned seed = 0; seed < 20; seed++)
+	{
+		TreeNode * root = make_random_tree(seed * 300, seed);
+
+		std::istringstream in(serialize_level_order(root));
+		std::vector<double> averages;
+
+		// A tiny chunk size makes tokens straddle chunk boundaries.
+		bool parsed = stream_average_of_levels(in, [&](double average) { averages.push_back(average); }, 1 + seed);
+
+		bool same = parsed && (averages == average_of_levels_1(root));
+
+		delete_tree(root);
+
+		if (!same)
+		{
+			std::cout << "test_stream_average_of_levels failed for seed " << seed << std::endl;
+			return;
+		}
+	}
+
+	std::vector<double> averages;
+	std::istringstream example("[3, 9, 20, null, null, 15, 7, null, null, null, null]");
+	bool passed = stream_average_of_levels(example, [&](double average) { averages.push_back(average); })
+		&& (averages == std::vector<double>({ 3.0, 14.5, 11.0 }));
+
+	std::istringstream extra_value("[1,2,3,null,null,null,null,4]");
+	std::istringstream bad_token("[1,2,nul]");
+	std::istringstream too_large("[2147483648]");
+
+	passed = passed
+		&& !stream_average_of_levels(extra_value, [](double) {})
+		&& !stream_average_of_levels(bad_token, [](double) {})
+		&& !stream_average_of_levels(too_large, [](double) {});
+
+	std::cout << "test_stream_average_of_levels " << (passed ? "passed" : "failed") << std::endl;
+}
+
+void benchmark_stream_average_of_levels()
+{
+	std::size_t const num_nodes = 1 << 21;
+
+	TreeNode * root = make_random_tree(num_nodes, 13);
+
+	std::string serialized = serialize_level_order(root);
+	std::vector<double> expected = average_of_levels_1(root);
+
+	delete_tree(root);
+
+	std::istringstream in(serialized);
+	std::vector<double> averages;
+
+	double ms = time_ms([&]() {
+		stream_average_of_levels(in, [&](double average) { averages.push_back(average); });
+	});
+
+	std::cout << std::setprecision(2);
+	std::cout << "benchmark_stream_average_of_levels (" << num_nodes << " nodes, "
+		<< serialized.size() / (1024.0 * 1024.0) << " MB)" << std::endl;
+	std::cout << "\tstream_average_of_levels : " << ms << " ms, "
+		<< serialized.size() / (1024.0 * 1024.0) / (ms / 1000.0) << " MB/s"
+		<< (averages == expected ? "" : " MISMATCH") << std::endl;
+}
+
+void test_level_average_generator()
+{
+	for (unsigned seed = 0; seed < 20; seed++)
+	{
+		TreeNode * root = make_random_tree(seed * 300, seed);
+
+		std::vector<double> expected = average_of_levels_1(root);
+
+		// Stop half way, then resume with the same generator.
+		LevelAverageGenerator generator(root);
+		std::vector<double> averages;
+		double average = 0.0;
+
+		while (averages.size() < expected.size() / 2 && generator.next(average))
+		{
+			averages.push_back(average);
+		}
+
+		while (generator.next(average))
+		{
+			averages.push_back(average);
+		}
+
+		bool same = (averages == expected) && (generator.num_levels_yielded() == expected.size());
+
+		delete_tree(root);
+
+		if (!same)
+		{
+			std::cout << "test_level_average_generator failed for seed " << seed << std::endl;
+			return;
+		}
+	}
+
+	std::cout << "test_level_average_generator passed" << std::endl;
+}
+
+/*
+ * Times the first k levels of the generator against a full
+ * 'average_of_levels_1', on a wide random tree and on a deep chain.
+ */
+void benchmark_level_average_generator()
+{
+	std::size_t const num_nodes = 1 << 21;
+
+	TreeNode * trees[] = { make_random_tree(num_nodes, 17), make_chain_tree(num_nodes) };
+	char const* names[] = { "wide", "deep" };
+
+	std::cout << std::setprecision(3);
+	std::cout << "benchmark_level_average_generator (" << num_nodes << " nodes)" << std::endl;
+
+	for (std::size_t t = 0; t < 2; t++)
+	{
+		std::cout << "\t" << names[t] << " tree, average_of_levels_1 : "
+			<< time_ms([&]() { average_of_levels_1(trees[t]); }) << " ms" << std::endl;
+
+		std::size_t const ks[] = { 1, 8, 16, 32 };
+
+		for (std::size_t const& k : ks)
+		{
+			double ms = time_ms([&]() {
+				LevelAverageGenerator generator(trees[t]);
+				double average = 0.0;
+
+				while (generator.num_levels_yielded() < k && generator.next(average))
+				{
+				}
+			});
+
+			std::cout << "\t" << names[t] << " tree, first " << k << " levels : " << ms << " ms" << std::endl;
+		}
+
+		delete_tree(trees[t]);
+	}
+}
+
+/*
+ * Returns the nodes of a tree in breadth-first order.
+ */
+std::vector<TreeNode*> collect_nodes(TreeNode * root)
+{
+	std::vector<TreeNode*> nodes;
+
+	if (root != nullptr)
+	{
+		nodes.push_back(root);
+	}
+
+	for (std::size_t i = 0; i < nodes.size(); i++)
+	{
+		if (nodes[i]->left != nullptr)
+		{
+			nodes.push_back(nodes[i]->left);
+		}
+
+		if (nodes[i]->right != nullptr)
+		{
+			nodes.push_back(nodes[i]->right);
+		}
+	}
+
+	return nodes;
+}
+
+void test_subtree_level_index()
+{
+	std::mt19937 generator(5);
+
+	for (unsigned seed = 1; seed < 20; seed++)
+	{
+		TreeNode * root = make_random_tree(seed * 200, seed);
+
+		SubtreeLevelIndex index(root);
+		std::vector<TreeNode*> nodes = collect_nodes(root);
+
+		bool passed = true;
+
+		for (int query = 0; passed && query < 200; query++)
+		{
+			TreeNode * node = nodes[generator() % nodes.size()];
+
+			std::vector<double> expected = average_of_levels_1(node);
+			int depth = static_cast<int>(generator() % (expected.size() + 2));
+
+			double average = index.average(node, depth);
+
+			passed = (static_cast<std::size_t>(depth) < expected.size())
+				? (average == expected[depth])
+				: std::isnan(average);
+		}
+
+		delete_tree(root);
+
+		if (!passed)
+		{
+			std::cout << "test_subtree_level_index failed for seed " << seed << std::endl;
+			return;
+		}
+	}
+
+	std::cout << "test_subtree_level_index passed" << std::endl;
+}
+
+void benchmark_subtree_level_index()
+{
+	std::size_t const num_nodes = 1 << 21;
+	std::size_t const num_queries = 1000000;
+	std::size_t const num_brute_force_queries = 1000;
+
+	TreeNode * root = make_random_tree(num_nodes, 19);
+	std::vector<TreeNode*> nodes = collect_nodes(root);
+
+	std::mt19937 generator(23);
+	std::vector<SubtreeLevelIndex::Query> queries;
+
+	// 'collect_nodes' is breadth-first, so these are the nodes of the top
+	// levels, whose subtrees are large enough for the queries to matter.
+	std::size_t const num_candidates = std::min<std::size_t>(nodes.size(), 4096);
+
+	for (std::size_t i = 0; i < num_queries; i++)
+	{
+		queries.push_back({ nodes[generator() % num_candidates], static_cast<int>(generator() % 16) });
+	}
+
+	std::unique_ptr<SubtreeLevelIndex> index;
+	std::vector<double> averages;
+
+	double ms_build = time_ms([&]() { index.reset(new SubtreeLevelIndex(root)); });
+	double ms_batch = time_ms([&]() { index->average_batch(queries, averages); });
+
+	double ms_brute_force = time_ms([&]() {
+		for (std::size_t i = 0; i < num_brute_force_queries; i++)
+		{
+			average_of_levels_1(const_cast<TreeNode*>(queries[i].node));
+		}
+	});
+
+	SubtreeLevelIndex::MemoryFootprint footprint = index->memory_footprint();
+
+	std::cout << std::setprecision(3);
+	std::cout << "benchmark_subtree_level_index (" << num_nodes << " nodes)" << std::endl;
+	std::cout << "\tbuild               : " << ms_build << " ms" << std::endl;
+	std::cout << "\taverage_batch       : " << 1e6 * ms_batch / num_queries << " ns/query" << std::endl;
+	std::cout << "\taverage_of_levels_1 : " << 1e6 * ms_brute_force / num_brute_force_queries << " ns/query" << std::endl;
+	std::cout << "\tmemory footprint    : " << footprint.total() / (1024.0 * 1024.0) << " MB ("
+		<< footprint.node_numbers / (1024.0 * 1024.0) << " MB node numbers, "
+		<< footprint.subtrees / (1024.0 * 1024.0) << " MB subtrees, "
+		<< footprint.levels / (1024.0 * 1024.0) << " MB levels)" << std::endl;
+
+	delete_tree(root);
+}
@@ -2,7 +2,7 @@
 
 clear
 
-g++ -std=c++14 -Werror -Wall -o test.o main.cpp
+g++ -std=c++14 -O2 -Werror -Wall -pthread -o test.o main.cpp
 
 ./test.o
 
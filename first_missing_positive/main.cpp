@@ -30,11 +30,152 @@
  */
 
 #include <iostream>
+#include <iomanip>
 #include <vector>
 #include <algorithm>
+#include <cstdint>
+#include <chrono>
+#include <random>
+#include <atomic>
+#include <thread>
+#include <memory>
+#include <fstream>
+#include <string>
+#include <cstdio>
+#include <set>
 
 int first_missing_positive(std::vector<int> & nums);
 
+int first_missing_positive(std::vector<int> const& nums);
+
+int first_missing_positive_bitmap(std::vector<int> const& nums, std::uint64_t * bits);
+
+int first_missing_positive_parallel(
+	std::vector<int> const& nums,
+	unsigned num_threads = std::thread::hardware_concurrency());
+
+/*
+ * The outcome of 'first_missing_positive_external'.
+ */
+struct ExternalSearchResult
+{
+	bool ok = false;
+	long long value = 0;
+	std::size_t num_passes = 0;
+	std::size_t bytes_read = 0;
+};
+
+template <typename Value>
+ExternalSearchResult first_missing_positive_external(std::string const& path, std::size_t memory_budget);
+
+template <typename Value>
+bool write_values(std::string const& path, std::vector<Value> const& values);
+
+/*
+ * A set of integers that answers "what is the smallest positive integer
+ * that is not in the set" as it changes, e.g. the lowest free ID.
+ *
+ * The values 1 .. capacity are bits of a hierarchical bitset: in
+ * levels[0], bit x - 1 is set when x is in the set, and in levels[k + 1],
+ * bit i is set when word i of levels[k] is full. The first zero bit, i.e.
+ * the answer, is found by walking down from the top level, one word per
+ * level. The values above the capacity go to 'overflow', and are moved
+ * into the bitset when it grows, so memory stays proportional to the
+ * number of values rather than to the largest one.
+ *
+ * insert, erase and smallest_missing take O(log64(capacity)) word
+ * operations, plus O(log n) for values in 'overflow'.
+ */
+class MissingPositiveSet
+{
+public:
+	explicit MissingPositiveSet(std::size_t initial_capacity = 1024);
+
+	// Returns false if 'x' was already in the set.
+	bool insert(int x);
+
+	// Returns false if 'x' was not in the set.
+	bool erase(int x);
+
+	int smallest_missing() const;
+
+private:
+	void set_bit(std::size_t bit);
+	void clear_bit(std::size_t bit);
+	void grow();
+
+	std::size_t capacity = 0;
+	std::size_t num_bits_set = 0;
+	std::vector<std::vector<std::uint64_t> > levels;
+	std::set<int> overflow;
+};
+
+/*
+ * A read-only view of a run of ints, e.g. one input of a batch.
+ */
+struct IntSpan
+{
+	int const* data;
+	std::size_t size;
+};
+
+/*
+ * The missing positive integers first .. last, inclusive.
+ */
+struct GapRange
+{
+	int first;
+	int last;
+};
+
+/*
+ * The bitmap memory of the functions below. It only ever grows, so once
+ * it has grown to fit the largest input, calls no longer allocate.
+ */
+class MissingScratch
+{
+public:
+	// Returns 'num_words' zeroed words.
+	std::uint64_t * zeroed_words(std::size_t num_words);
+
+private:
+	std::vector<std::uint64_t> words;
+};
+
+void missing_ranges(IntSpan nums, MissingScratch & scratch, std::vector<GapRange> & ranges);
+
+void k_smallest_missing(IntSpan nums, std::size_t k, MissingScratch & scratch, int * missing);
+
+void missing_ranges_batch(
+	std::vector<IntSpan> const& inputs,
+	MissingScratch & scratch,
+	std::vector<GapRange> & ranges,
+	std::vector<std::size_t> & offsets);
+
+void k_smallest_missing_batch(
+	std::vector<IntSpan> const& inputs,
+	std::size_t k,
+	MissingScratch & scratch,
+	std::vector<int> & missing);
+
+std::vector<int> make_distinct_input(std::size_t size, unsigned seed);
+
+std::vector<int> make_random_input(std::size_t size, unsigned seed);
+
+template <typename Function>
+double time_ms(Function function);
+
+void test_first_missing_positive_bitmap();
+void benchmark_first_missing_positive();
+void test_first_missing_positive_parallel();
+void benchmark_first_missing_positive_parallel();
+void test_first_missing_positive_external();
+void benchmark_first_missing_positive_external();
+void test_missing_positive_set();
+void benchmark_missing_positive_set();
+void test_missing_ranges();
+void benchmark_missing_ranges_batch();
+
 int main()
 {
 	std::vector<int> nums = { 3, 5, -1, 1 };
@@ -46,6 +187,29 @@ int main()
 	nums = { -7, -6, 4, 5, 3 };
 	std::cout << first_missing_positive(nums)  << std::endl;
 
+	std::vector<int> const shared_nums = { 3, 4, -1, 1 };
+	std::cout << first_missing_positive(shared_nums)  << std::endl;
+
+	test_first_missing_positive_bitmap();
+
+	benchmark_first_missing_positive();
+
+	test_first_missing_positive_parallel();
+
+	benchmark_first_missing_positive_parallel();
+
+	test_first_missing_positive_external();
+
+	benchmark_first_missing_positive_external();
+
+	test_missing_positive_set();
+
+	benchmark_missing_positive_set();
+
+	test_missing_ranges();
+
+	benchmark_missing_ranges_batch();
+
 	return 0;
 }
 
@@ -80,3 +244,1193 @@ int first_missing_positive(std::vector<int> & nums)
 
 	return nums.size() + 1;
 }
+
+/*
+ * Up to this many words, the bitmap of the const overload lives on the
+ * stack, so small inputs do not pay for a heap allocation.
+ */
+std::size_t const small_bitmap_words = 64;
+
+/*
+ * The same question, for callers that cannot have their vector re-arranged.
+ * This always goes through the bitmap solution below, which never writes
+ * to 'nums'. Copying small inputs to re-arrange them in place was measured
+ * too, and was slower at every size, so the size only decides where the
+ * bitmap is allocated.
+ */
+int first_missing_positive(std::vector<int> const& nums)
+{
+	std::size_t const num_words = nums.size() / 64 + 1;
+
+	if (num_words <= small_bitmap_words)
+	{
+		std::uint64_t bits[small_bitmap_words];
+		std::fill_n(bits, num_words, 0);
+
+		return first_missing_positive_bitmap(nums, bits);
+	}
+
+	std::vector<std::uint64_t> bits(num_words, 0);
+
+	return first_missing_positive_bitmap(nums, bits.data());
+}
+
+/*
+ * This solution marks each value x, such that 1 <= x <= nums.size(), in a
+ * bitmap where bit x - 1 stands for x. The input is read once, in order,
+ * and the only random accesses are to a bitmap that is 32 times smaller
+ * than the input. The first zero bit is then found a 64-bit word at a
+ * time: the lowest zero bit of a word is the lowest set bit of its
+ * complement, which '__builtin_ctzll' counts in one instruction.
+ *
+ * 'bits' must hold nums.size() / 64 + 1 zeroed words. That is at least one
+ * bit more than nums.size(), and that bit is never set, so the scan
+ * always stops on or before the bit of nums.size() + 1.
+ */
+int first_missing_positive_bitmap(std::vector<int> const& nums, std::uint64_t * bits)
+{
+	std::size_t const size = nums.size();
+	std::size_t const num_words = size / 64 + 1;
+
+	for (int const& x : nums)
+	{
+		if (x > 0 && static_cast<std::size_t>(x) <= size)
+		{
+			std::size_t bit = static_cast<std::size_t>(x) - 1;
+			bits[bit / 64] |= std::uint64_t(1) << (bit % 64);
+		}
+	}
+
+	for (std::size_t word = 0; word < num_words; word++)
+	{
+		if (~bits[word] != 0)
+		{
+			return static_cast<int>(word * 64 + __builtin_ctzll(~bits[word]) + 1);
+		}
+	}
+
+	return static_cast<int>(size + 1);
+}
+
+/*
+ * Runs function(i) on 'num_threads' threads, for i in [ 0, num_threads ),
+ * and returns once all of them are done. Thread 0 is the calling thread.
+ */
+template <typename Function>
+void run_in_parallel(unsigned num_threads, Function function)
+{
+	std::vector<std::thread> threads;
+
+	for (unsigned i = 1; i < num_threads; i++)
+	{
+		threads.emplace_back(function, i);
+	}
+
+	function(0u);
+
+	for (std::thread & thread : threads)
+	{
+		thread.join();
+	}
+}
+
+/*
+ * The bitmap solution, split across threads in three rounds:
+ *
+ *	1. each thread zeroes a slice of a shared bitmap of atomic words,
+ *	2. each thread marks the values of a slice of 'nums', with a plain
+ *	   load first so that a bit that is already set costs no atomic
+ *	   read-modify-write, which matters for duplicates and hot words,
+ *	3. each thread scans a slice of the words for its first zero bit, and
+ *	   lowers the shared 'first_zero_bit' to it. A thread whose slice
+ *	   starts past the lowest zero bit found so far skips its scan.
+ *
+ * The lowest zero bit of the whole bitmap is the minimum of the lowest
+ * zero bits of the slices, so the result is the same as the sequential
+ * solutions, whatever the number of threads.
+ */
+int first_missing_positive_parallel(std::vector<int> const& nums, unsigned num_threads)
+{
+	std::size_t const size = nums.size();
+	std::size_t const num_words = size / 64 + 1;
+
+	// On one thread, the plain bitmap saves the atomic operations.
+	if (num_threads <= 1)
+	{
+		return first_missing_positive(nums);
+	}
+
+	std::unique_ptr<std::atomic<std::uint64_t>[]> bits(new std::atomic<std::uint64_t>[num_words]);
+
+	run_in_parallel(num_threads, [&](unsigned thread_index) {
+		std::size_t begin = num_words * thread_index / num_threads;
+		std::size_t end = num_words * (thread_index + 1) / num_threads;
+
+		for (std::size_t word = begin; word < end; word++)
+		{
+			bits[word].store(0, std::memory_order_relaxed);
+		}
+	});
+
+	run_in_parallel(num_threads, [&](unsigned thread_index) {
+		std::size_t begin = size * thread_index / num_threads;
+		std::size_t end = size * (thread_index + 1) / num_threads;
+
+		for (std::size_t i = begin; i < end; i++)
+		{
+			int x = nums[i];
+
+			if (x > 0 && static_cast<std::size_t>(x) <= size)
+			{
+				std::size_t bit = static_cast<std::size_t>(x) - 1;
+				std::uint64_t mask = std::uint64_t(1) << (bit % 64);
+
+				if ((bits[bit / 64].load(std::memory_order_relaxed) & mask) == 0)
+				{
+					bits[bit / 64].fetch_or(mask, std::memory_order_relaxed);
+				}
+			}
+		}
+	});
+
+	std::atomic<std::size_t> first_zero_bit(num_words * 64);
+
+	run_in_parallel(num_threads, [&](unsigned thread_index) {
+		std::size_t begin = num_words * thread_index / num_threads;
+		std::size_t end = num_words * (thread_index + 1) / num_threads;
+
+		for (std::size_t word = begin; word < end && word * 64 < first_zero_bit.load(); word++)
+		{
+			std::uint64_t zeros = ~bits[word].load(std::memory_order_relaxed);
+
+			if (zeros != 0)
+			{
+				std::size_t bit = word * 64 + __builtin_ctzll(zeros);
+				std::size_t current = first_zero_bit.load();
+
+				while (bit < current && !first_zero_bit.compare_exchange_weak(current, bit))
+				{
+				}
+
+				break;
+			}
+		}
+	});
+
+	return static_cast<int>(first_zero_bit.load() + 1);
+}
+
+/*
+ * Reads every value of a file of raw 'Value's, 'buffer.size()' values at a
+ * time, and calls visit(value) on each one. Adds the bytes read to
+ * 'bytes_read'. Returns false if the file cannot be read.
+ */
+template <typename Value, typename Visit>
+bool for_each_value(std::string const& path, std::vector<Value> & buffer, std::size_t & bytes_read, Visit visit)
+{
+	std::ifstream in(path, std::ios::binary);
+
+	if (!in)
+	{
+		return false;
+	}
+
+	while (in)
+	{
+		in.read(reinterpret_cast<char*>(buffer.data()), buffer.size() * sizeof(Value));
+
+		std::size_t num_bytes = static_cast<std::size_t>(in.gcount());
+		bytes_read += num_bytes;
+
+		for (std::size_t i = 0; i < num_bytes / sizeof(Value); i++)
+		{
+			visit(buffer[i]);
+		}
+	}
+
+	return in.eof();
+}
+
+/*
+ * The same question, for a file of raw, native-endian 'Value's (int32_t or
+ * int64_t) that may be larger than memory. At most 'memory_budget' bytes
+ * are used, split between a read buffer and the counters of a pass.
+ *
+ * With N values in the file, the answer is in [ 1, N + 1 ]. Each pass
+ * narrows that candidate range:
+ *
+ *	- while it is too wide for a bitmap within the budget, a pass splits
+ *	  it into as many buckets as there are counters, counts the values
+ *	  in each bucket, and keeps the first bucket with fewer values than
+ *	  its width, which must have a gap,
+ *	- once it fits, a last pass marks its values in a bitmap, and the
+ *	  first zero bit is the answer.
+ *
+ * So the number of passes grows with log(N / budget), in base budget / 8.
+ *
+ * Counting cannot tell duplicates apart, so this expects the positive
+ * values of the file to be distinct, as in a set of IDs. With duplicates,
+ * a bucket with a gap can look full. The value returned is then still
+ * missing from the file, but it may not be the smallest one.
+ */
+template <typename Value>
+ExternalSearchResult first_missing_positive_external(std::string const& path, std::size_t memory_budget)
+{
+	ExternalSearchResult result;
+
+	std::ifstream in(path, std::ios::binary | std::ios::ate);
+
+	if (!in)
+	{
+		return result;
+	}
+
+	unsigned long long const num_values = static_cast<unsigned long long>(in.tellg()) / sizeof(Value);
+	in.close();
+
+	// A quarter of the budget is the read buffer, the rest holds the counters.
+	std::size_t buffer_bytes = std::max<std::size_t>(memory_budget / 4, sizeof(Value));
+	std::size_t counter_bytes = std::max<std::size_t>(memory_budget - std::min(memory_budget, buffer_bytes), 2 * sizeof(std::uint64_t));
+
+	std::vector<Value> buffer(buffer_bytes / sizeof(Value));
+	std::vector<std::uint64_t> counters(counter_bytes / sizeof(std::uint64_t));
+
+	unsigned long long low = 1;
+	unsigned long long high = num_values + 1;
+
+	while (high - low + 1 > counters.size() * 64)
+	{
+		unsigned long long const width = high - low + 1;
+		unsigned long long const bucket_width = (width + counters.size() - 1) / counters.size();
+
+		std::fill(counters.begin(), counters.end(), 0);
+
+		bool read = for_each_value(path, buffer, result.bytes_read, [&](Value x) {
+			if (x > 0 && static_cast<unsigned long long>(x) >= low && static_cast<unsigned long long>(x) <= high)
+			{
+				counters[(static_cast<unsigned long long>(x) - low) / bucket_width]++;
+			}
+		});
+
+		result.num_passes++;
+
+		if (!read)
+		{
+			return result;
+		}
+
+		for (std::size_t bucket = 0; ; bucket++)
+		{
+			unsigned long long bucket_low = low + bucket * bucket_width;
+			unsigned long long bucket_high = std::min(high, bucket_low + bucket_width - 1);
+
+			if (counters[bucket] < bucket_high - bucket_low + 1)
+			{
+				low = bucket_low;
+				high = bucket_high;
+				break;
+			}
+		}
+	}
+
+	std::fill(counters.begin(), counters.end(), 0);
+
+	bool read = for_each_value(path, buffer, result.bytes_read, [&](Value x) {
+		if (x > 0 && static_cast<unsigned long long>(x) >= low && static_cast<unsigned long long>(x) <= high)
+		{
+			unsigned long long bit = static_cast<unsigned long long>(x) - low;
+			counters[bit / 64] |= std::uint64_t(1) << (bit % 64);
+		}
+	});
+
+	result.num_passes++;
+
+	if (!read)
+	{
+		return result;
+	}
+
+	for (std::size_t word = 0; ; word++)
+	{
+		if (~counters[word] != 0)
+		{
+			result.value = static_cast<long long>(low + word * 64 + __builtin_ctzll(~counters[word]));
+			break;
+		}
+	}
+
+	result.ok = true;
+
+	return result;
+}
+
+template <typename Value>
+bool write_values(std::string const& path, std::vector<Value> const& values)
+{
+	std::ofstream out(path, std::ios::binary | std::ios::trunc);
+
+	out.write(reinterpret_cast<char const*>(values.data()), values.size() * sizeof(Value));
+
+	return static_cast<bool>(out);
+}
+
+MissingPositiveSet::MissingPositiveSet(std::size_t initial_capacity)
+{
+	capacity = std::max<std::size_t>((initial_capacity + 63) / 64 * 64, 64);
+
+	// Each level has one bit per word of the level below, up to a single word.
+	levels.emplace_back(capacity / 64, 0);
+
+	while (levels.back().size() > 1)
+	{
+		levels.emplace_back((levels.back().size() + 63) / 64, 0);
+	}
+}
+
+/*
+ * Sets a bit of levels[0], and marks the words that became full on the
+ * way up.
+ */
+void MissingPositiveSet::set_bit(std::size_t bit)
+{
+	for (std::size_t level = 0; level < levels.size(); level++)
+	{
+		std::uint64_t & word = levels[level][bit / 64];
+		word |= std::uint64_t(1) << (bit % 64);
+
+		if (word != ~std::uint64_t(0))
+		{
+			break;
+		}
+
+		bit /= 64;
+	}
+}
+
+/*
+ * Clears a bit of levels[0], and unmarks the words that were full on the
+ * way up.
+ */
+void MissingPositiveSet::clear_bit(std::size_t bit)
+{
+	for (std::size_t level = 0; level < levels.size(); level++)
+	{
+		std::uint64_t & word = levels[level][bit / 64];
+		bool was_full = (word == ~std::uint64_t(0));
+
+		word &= ~(std::uint64_t(1) << (bit % 64));
+
+		if (!was_full)
+		{
+			break;
+		}
+
+		bit /= 64;
+	}
+}
+
+/*
+ * Doubles the capacity once every bit is set, so that there is always a
+ * zero bit for 'smallest_missing' to find, and moves the values of
+ * 'overflow' that now fit into the bitset.
+ */
+void MissingPositiveSet::grow()
+{
+	std::size_t old_num_words = levels[0].size();
+	std::set<int> old_overflow;
+	old_overflow.swap(overflow);
+
+	*this = MissingPositiveSet(2 * capacity);
+
+	// The bitset was full, so the old values are all of 1 .. old capacity.
+	std::fill_n(levels[0].begin(), old_num_words, ~std::uint64_t(0));
+
+	for (std::size_t level = 1; level < levels.size(); level++)
+	{
+		for (std::size_t word = 0; word < levels[level - 1].size(); word++)
+		{
+			if (levels[level - 1][word] == ~std::uint64_t(0))
+			{
+				levels[level][word / 64] |= std::uint64_t(1) << (word % 64);
+			}
+		}
+	}
+
+	num_bits_set = old_num_words * 64;
+
+	for (int const& value : old_overflow)
+	{
+		if (static_cast<std::size_t>(value) <= capacity)
+		{
+			set_bit(static_cast<std::size_t>(value) - 1);
+			num_bits_set++;
+		}
+		else
+		{
+			overflow.insert(overflow.end(), value);
+		}
+	}
+}
+
+bool MissingPositiveSet::insert(int x)
+{
+	if (x <= 0)
+	{
+		return false;
+	}
+
+	if (static_cast<std::size_t>(x) > capacity)
+	{
+		return overflow.insert(x).second;
+	}
+
+	std::size_t bit = static_cast<std::size_t>(x) - 1;
+
+	if (levels[0][bit / 64] & (std::uint64_t(1) << (bit % 64)))
+	{
+		return false;
+	}
+
+	set_bit(bit);
+	num_bits_set++;
+
+	while (num_bits_set == capacity)
+	{
+		grow();
+	}
+
+	return true;
+}
+
+bool MissingPositiveSet::erase(int x)
+{
+	if (x <= 0)
+	{
+		return false;
+	}
+
+	if (static_cast<std::size_t>(x) > capacity)
+	{
+		return overflow.erase(x) > 0;
+	}
+
+	std::size_t bit = static_cast<std::size_t>(x) - 1;
+
+	if (!(levels[0][bit / 64] & (std::uint64_t(1) << (bit % 64))))
+	{
+		return false;
+	}
+
+	clear_bit(bit);
+	num_bits_set--;
+
+	return true;
+}
+
+/*
+ * Follows the first zero bit from the top level down. A zero bit above
+ * levels[0] means that the word below it is not full, so the walk never
+ * dead-ends, and since the bitset is never full it always finds a bit.
+ */
+int MissingPositiveSet::smallest_missing() const
+{
+	std::size_t index = 0;
+
+	for (std::size_t level = levels.size(); level-- > 0; )
+	{
+		index = index * 64 + __builtin_ctzll(~levels[level][index]);
+	}
+
+	return static_cast<int>(index + 1);
+}
+
+std::uint64_t * MissingScratch::zeroed_words(std::size_t num_words)
+{
+	if (words.size() < num_words)
+	{
+		words.resize(num_words);
+	}
+
+	std::fill_n(words.begin(), num_words, 0);
+
+	return words.data();
+}
+
+/*
+ * Sets bit x - 1 of 'bits' for each value x of 'nums' in [ 1, num_bits ].
+ */
+void mark_values(IntSpan nums, std::size_t num_bits, std::uint64_t * bits)
+{
+	for (std::size_t i = 0; i < nums.size; i++)
+	{
+		int x = nums.data[i];
+
+		if (x > 0 && static_cast<std::size_t>(x) <= num_bits)
+		{
+			std::size_t bit = static_cast<std::size_t>(x) - 1;
+			bits[bit / 64] |= std::uint64_t(1) << (bit % 64);
+		}
+	}
+}
+
+/*
+ * Returns the index of the first bit at or after 'from' that is set (or,
+ * with 'set' false, clear), or 'num_words * 64' if there is none. Whole
+ * words that cannot hold such a bit are skipped with one comparison.
+ */
+std::size_t find_next_bit(std::uint64_t const* bits, std::size_t num_words, std::size_t from, bool set)
+{
+	std::size_t word = from / 64;
+
+	if (word >= num_words)
+	{
+		return num_words * 64;
+	}
+
+	std::uint64_t const flip = set ? 0 : ~std::uint64_t(0);
+
+	// Ignore the bits below 'from' in its word.
+	std::uint64_t candidates = (bits[word] ^ flip) & (~std::uint64_t(0) << (from % 64));
+
+	while (candidates == 0)
+	{
+		if (++word == num_words)
+		{
+			return num_words * 64;
+		}
+
+		candidates = bits[word] ^ flip;
+	}
+
+	return word * 64 + __builtin_ctzll(candidates);
+}
+
+/*
+ * Appends the ranges of the positive integers in [ 1, nums.size ] that are
+ * missing from 'nums' to 'ranges', in increasing order. Each range is
+ * found with two word-level scans, one for its first missing value and
+ * one for the next present value, instead of one test per value.
+ */
+void missing_ranges(IntSpan nums, MissingScratch & scratch, std::vector<GapRange> & ranges)
+{
+	std::size_t const num_bits = nums.size;
+	std::size_t const num_words = num_bits / 64 + 1;
+
+	std::uint64_t * bits = scratch.zeroed_words(num_words);
+
+	mark_values(nums, num_bits, bits);
+
+	std::size_t bit = 0;
+
+	while (bit < num_bits)
+	{
+		std::size_t first = find_next_bit(bits, num_words, bit, false);
+
+		if (first >= num_bits)
+		{
+			break;
+		}
+
+		std::size_t last = std::min(find_next_bit(bits, num_words, first, true), num_bits);
+
+		ranges.push_back({ static_cast<int>(first + 1), static_cast<int>(last) });
+
+		bit = last;
+	}
+}
+
+/*
+ * Writes the 'k' smallest positive integers that are missing from 'nums'
+ * to missing[0 .. k). At most nums.size of [ 1, nums.size + k ] can be
+ * present, so the answers all lie in that range, and are the first k
+ * zero bits of its bitmap.
+ */
+void k_smallest_missing(IntSpan nums, std::size_t k, MissingScratch & scratch, int * missing)
+{
+	std::size_t const num_bits = nums.size + k;
+	std::size_t const num_words = num_bits / 64 + 1;
+
+	std::uint64_t * bits = scratch.zeroed_words(num_words);
+
+	mark_values(nums, num_bits, bits);
+
+	std::size_t found = 0;
+
+	for (std::size_t word = 0; found < k; word++)
+	{
+		std::uint64_t zeros = ~bits[word];
+
+		while (zeros != 0 && found < k)
+		{
+			missing[found++] = static_cast<int>(word * 64 + __builtin_ctzll(zeros) + 1);
+
+			// Clear the lowest set bit.
+			zeros &= zeros - 1;
+		}
+	}
+}
+
+/*
+ * Runs 'missing_ranges' on each input. The ranges of input i end up in
+ * ranges[ offsets[i], offsets[i + 1] ). 'ranges' and 'offsets' are
+ * cleared first, and keep their capacity, so a caller that reuses them
+ * and 'scratch' across batches allocates nothing once they have grown.
+ */
+void missing_ranges_batch(
+	std::vector<IntSpan> const& inputs,
+	MissingScratch & scratch,
+	std::vector<GapRange> & ranges,
+	std::vector<std::size_t> & offsets)
+{
+	ranges.clear();
+	offsets.clear();
+
+	for (IntSpan const& nums : inputs)
+	{
+		offsets.push_back(ranges.size());
+		missing_ranges(nums, scratch, ranges);
+	}
+
+	offsets.push_back(ranges.size());
+}
+
+/*
+ * Runs 'k_smallest_missing' on each input. The answers of input i end up
+ * in missing[ i * k, (i + 1) * k ). As with 'missing_ranges_batch',
+ * nothing is allocated once 'missing' and 'scratch' have grown.
+ */
+void k_smallest_missing_batch(
+	std::vector<IntSpan> const& inputs,
+	std::size_t k,
+	MissingScratch & scratch,
+	std::vector<int> & missing)
+{
+	missing.resize(inputs.size() * k);
+
+	for (std::size_t i = 0; i < inputs.size(); i++)
+	{
+		k_smallest_missing(inputs[i], k, scratch, missing.data() + i * k);
+	}
+}
+
+/*
+ * Returns a shuffled vector of distinct values: most of 1 .. size, where
+ * about one value in a thousand has been replaced by a value that is too
+ * large or not positive.
+ */
+std::vector<int> make_distinct_input(std::size_t size, unsigned seed)
+{
+	std::mt19937 generator(seed);
+
+	std::vector<int> nums(size);
+
+	for (std::size_t i = 0; i < size; i++)
+	{
+		nums[i] = static_cast<int>(i + 1);
+
+		if (generator() % 1000 == 0)
+		{
+			nums[i] = (generator() % 2 == 0) ? static_cast<int>(size + 1 + i) : -static_cast<int>(i);
+		}
+	}
+
+	std::shuffle(nums.begin(), nums.end(), generator);
+
+	return nums;
+}
+
+/*
+ * Returns a shuffled vector that holds most of 1 .. size, where about
+ * one value in a thousand has been replaced by a duplicate, a value that
+ * is too large, or a value that is not positive.
+ */
+std::vector<int> make_random_input(std::size_t size, unsigned seed)
+{
+	std::mt19937 generator(seed);
+
+	std::vector<int> nums(size);
+
+	for (std::size_t i = 0; i < size; i++)
+	{
+		nums[i] = static_cast<int>(i + 1);
+	}
+
+	for (std::size_t i = 0; i < size; i++)
+	{
+		if (generator() % 1000 == 0)
+		{
+			int choice = static_cast<int>(generator() % 3);
+
+			if (choice == 0)
+			{
+				nums[i] = nums[generator() % size];
+			}
+			else if (choice == 1)
+			{
+				nums[i] = static_cast<int>(size + 1 + generator() % 100);
+			}
+			else
+			{
+				nums[i] = -static_cast<int>(generator() % 100);
+			}
+		}
+	}
+
+	std::shuffle(nums.begin(), nums.end(), generator);
+
+	return nums;
+}
+
+template <typename Function>
+double time_ms(Function function)
+{
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	function();
+
+	std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+
+	return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+void test_first_missing_positive_bitmap()
+{
+	std::mt19937 generator(3);
+
+	for (unsigned seed = 0; seed < 200; seed++)
+	{
+		std::size_t size = generator() % 10000;
+
+		std::vector<int> nums(size);
+
+		for (int & x : nums)
+		{
+			x = static_cast<int>(generator() % (size + 10)) - 5;
+		}
+
+		std::vector<int> const original = nums;
+
+		int bitmap = first_missing_positive(original);
+		int in_place = first_missing_positive(nums);
+
+		if (bitmap != in_place)
+		{
+			std::cout << "test_first_missing_positive_bitmap failed for seed " << seed << std::endl;
+			return;
+		}
+	}
+
+	std::cout << "test_first_missing_positive_bitmap passed" << std::endl;
+}
+
+void benchmark_first_missing_positive()
+{
+	std::size_t const max_size = 100000000;
+
+	std::cout << std::setprecision(3) << std::fixed;
+	std::cout << "benchmark_first_missing_positive" << std::endl;
+
+	for (std::size_t size = 1000; size <= max_size; size *= 10)
+	{
+		std::vector<int> const nums = make_random_input(size, 7);
+		std::vector<int> copy = nums;
+
+		int in_place = 0;
+		int bitmap = 0;
+
+		double ms_in_place = time_ms([&]() { in_place = first_missing_positive(copy); });
+		double ms_bitmap = time_ms([&]() { bitmap = first_missing_positive(nums); });
+
+		std::cout << "\t" << std::setw(9) << size << " elements : in place " << ms_in_place
+			<< " ms, bitmap " << ms_bitmap << " ms"
+			<< (in_place == bitmap ? "" : " MISMATCH") << std::endl;
+	}
+}
+
+void test_first_missing_positive_parallel()
+{
+	std::mt19937 generator(5);
+
+	for (unsigned seed = 0; seed < 200; seed++)
+	{
+		std::size_t size = generator() % 20000;
+
+		std::vector<int> nums(size);
+
+		for (int & x : nums)
+		{
+			x = static_cast<int>(generator() % (size + 10)) - 5;
+		}
+
+		std::vector<int> const original = nums;
+
+		int parallel = first_missing_positive_parallel(original, 1 + seed % 8);
+		int in_place = first_missing_positive(nums);
+
+		if (parallel != in_place)
+		{
+			std::cout << "test_first_missing_positive_parallel failed for seed " << seed << std::endl;
+			return;
+		}
+	}
+
+	std::cout << "test_first_missing_positive_parallel passed" << std::endl;
+}
+
+void benchmark_first_missing_positive_parallel()
+{
+	std::size_t const size = 100000000;
+
+	std::vector<int> const nums = make_random_input(size, 11);
+
+	int expected = 0;
+	double ms_bitmap = time_ms([&]() { expected = first_missing_positive(nums); });
+
+	std::cout << std::setprecision(3) << std::fixed;
+	std::cout << "benchmark_first_missing_positive_parallel (" << size << " elements)" << std::endl;
+	std::cout << "\tbitmap, 1 thread : " << ms_bitmap << " ms" << std::endl;
+
+	unsigned max_threads = std::max(4u, std::thread::hardware_concurrency());
+
+	for (unsigned num_threads = 1; num_threads <= max_threads; num_threads *= 2)
+	{
+		int parallel = 0;
+
+		double ms = time_ms([&]() { parallel = first_missing_positive_parallel(nums, num_threads); });
+
+		std::cout << "\tparallel, " << num_threads << " threads : " << ms << " ms"
+			<< (parallel == expected ? "" : " MISMATCH") << std::endl;
+	}
+}
+
+void test_first_missing_positive_external()
+{
+	std::string const path = "first_missing_positive_test.bin";
+
+	std::mt19937 generator(9);
+
+	for (unsigned seed = 0; seed < 50; seed++)
+	{
+		std::vector<int> nums = make_distinct_input(generator() % 100000, seed);
+
+		// Drop a few more values, so the answer is not always near the end.
+		for (int i = 0; i < 3 && !nums.empty(); i++)
+		{
+			nums[generator() % nums.size()] = 0;
+		}
+
+		std::vector<long long> wide_nums(nums.begin(), nums.end());
+
+		// Budgets this small force several counting passes.
+		std::size_t budget = 64 + generator() % 2048;
+
+		write_values(path, nums);
+		ExternalSearchResult result_32 = first_missing_positive_external<std::int32_t>(path, budget);
+
+		write_values(path, wide_nums);
+		ExternalSearchResult result_64 = first_missing_positive_external<std::int64_t>(path, budget);
+
+		int expected = first_missing_positive(nums);
+
+		if (!result_32.ok || !result_64.ok || result_32.value != expected || result_64.value != expected)
+		{
+			std::cout << "test_first_missing_positive_external failed for seed " << seed << std::endl;
+			std::remove(path.c_str());
+			return;
+		}
+	}
+
+	std::remove(path.c_str());
+
+	ExternalSearchResult missing_file = first_missing_positive_external<std::int32_t>(path, 1024);
+
+	std::cout << "test_first_missing_positive_external " << (missing_file.ok ? "failed" : "passed") << std::endl;
+}
+
+void benchmark_first_missing_positive_external()
+{
+	std::string const path = "first_missing_positive_benchmark.bin";
+	std::size_t const size = 50000000;
+
+	std::vector<int> nums = make_distinct_input(size, 13);
+	int expected = first_missing_positive(nums);
+
+	write_values(path, nums);
+	nums.clear();
+	nums.shrink_to_fit();
+
+	std::cout << std::setprecision(3) << std::fixed;
+	std::cout << "benchmark_first_missing_positive_external (" << size << " int32 values)" << std::endl;
+
+	std::size_t const budgets[] = { 1 << 12, 1 << 16, 1 << 20, 1 << 24 };
+
+	for (std::size_t const& budget : budgets)
+	{
+		ExternalSearchResult result;
+
+		double ms = time_ms([&]() { result = first_missing_positive_external<std::int32_t>(path, budget); });
+
+		std::cout << "\tbudget " << std::setw(8) << budget << " bytes : " << ms << " ms, "
+			<< result.num_passes << " passes, " << result.bytes_read / (1024.0 * 1024.0) << " MB read"
+			<< (result.ok && result.value == expected ? "" : " MISMATCH") << std::endl;
+	}
+
+	std::remove(path.c_str());
+}
+
+void test_missing_positive_set()
+{
+	std::mt19937 generator(17);
+
+	MissingPositiveSet missing(64);
+	std::set<int> mirror;
+
+	for (int step = 0; step < 50000; step++)
+	{
+		// The range drifts upwards, so the set grows past its capacity
+		// and the overflow values get moved into the bitset.
+		int x = static_cast<int>(generator() % (300 + step / 10)) - 5;
+
+		bool changed = false;
+		bool expected_change = false;
+
+		switch (generator() % 4)
+		{
+		case 0:
+		case 1:
+			changed = missing.insert(x);
+			expected_change = (x > 0) && mirror.insert(x).second;
+			break;
+		case 2:
+			changed = missing.erase(x);
+			expected_change = (mirror.erase(x) > 0);
+			break;
+		default:
+			// Allocate the lowest free value, as an ID allocator would.
+			x = missing.smallest_missing();
+			changed = missing.insert(x);
+			expected_change = mirror.insert(x).second;
+			break;
+		}
+
+		std::vector<int> snapshot(mirror.begin(), mirror.end());
+
+		if (changed != expected_change || missing.smallest_missing() != first_missing_positive(snapshot))
+		{
+			std::cout << "test_missing_positive_set failed at step " << step << std::endl;
+			return;
+		}
+	}
+
+	std::cout << "test_missing_positive_set passed" << std::endl;
+}
+
+/*
+ * A mixed ID-allocation workload: allocate the lowest free ID, free a
+ * random ID, or only query, against re-running 'first_missing_positive'
+ * on a snapshot for each query.
+ */
+void benchmark_missing_positive_set()
+{
+	std::size_t const num_ops = 10000000;
+	std::size_t const num_snapshot_ops = 100;
+	std::size_t const initial_ids = 1000000;
+
+	std::mt19937 generator(29);
+
+	MissingPositiveSet missing;
+	std::vector<int> ids;
+
+	for (std::size_t i = 1; i <= initial_ids; i++)
+	{
+		missing.insert(static_cast<int>(i));
+		ids.push_back(static_cast<int>(i));
+	}
+
+	long checksum = 0;
+
+	double ms = time_ms([&]() {
+		for (std::size_t op = 0; op < num_ops; op++)
+		{
+			unsigned choice = generator() % 10;
+
+			if (choice < 4)
+			{
+				int id = missing.smallest_missing();
+				missing.insert(id);
+				ids.push_back(id);
+			}
+			else if (choice < 8)
+			{
+				std::size_t i = generator() % ids.size();
+				missing.erase(ids[i]);
+				ids[i] = ids.back();
+				ids.pop_back();
+			}
+			else
+			{
+				checksum += missing.smallest_missing();
+			}
+		}
+	});
+
+	double ms_snapshot = time_ms([&]() {
+		for (std::size_t op = 0; op < num_snapshot_ops; op++)
+		{
+			std::vector<int> snapshot = ids;
+			checksum += first_missing_positive(snapshot);
+		}
+	});
+
+	std::cout << std::setprecision(3) << std::fixed;
+	std::cout << "benchmark_missing_positive_set (" << initial_ids << " initial IDs, checksum " << checksum << ")" << std::endl;
+	std::cout << "\tMissingPositiveSet : " << num_ops / (ms / 1000.0) << " ops/s" << std::endl;
+	std::cout << "\tsnapshot per query : " << num_snapshot_ops / (ms_snapshot / 1000.0) << " ops/s" << std::endl;
+}
+
+void test_missing_ranges()
+{
+	std::mt19937 generator(31);
+
+	std::size_t const k = 5;
+
+	std::vector<std::vector<int> > vectors;
+
+	for (int i = 0; i < 300; i++)
+	{
+		std::size_t size = generator() % 500;
+		std::vector<int> nums(size);
+
+		for (int & x : nums)
+		{
+			x = static_cast<int>(generator() % (size + size / 2 + 2)) - 2;
+		}
+
+		vectors.push_back(nums);
+	}
+
+	std::vector<IntSpan> inputs;
+
+	for (std::vector<int> const& nums : vectors)
+	{
+		inputs.push_back({ nums.data(), nums.size() });
+	}
+
+	MissingScratch scratch;
+	std::vector<GapRange> ranges;
+	std::vector<std::size_t> offsets;
+	std::vector<int> missing;
+
+	missing_ranges_batch(inputs, scratch, ranges, offsets);
+	k_smallest_missing_batch(inputs, k, scratch, missing);
+
+	for (std::size_t i = 0; i < vectors.size(); i++)
+	{
+		std::set<int> present(vectors[i].begin(), vectors[i].end());
+
+		// Rebuild the answers one value at a time.
+		std::vector<int> expected_missing;
+		std::vector<int> missing_from_ranges;
+
+		for (int x = 1; expected_missing.size() < k; x++)
+		{
+			if (present.count(x) == 0)
+			{
+				expected_missing.push_back(x);
+			}
+		}
+
+		for (std::size_t r = offsets[i]; r < offsets[i + 1]; r++)
+		{
+			for (int x = ranges[r].first; x <= ranges[r].last; x++)
+			{
+				missing_from_ranges.push_back(x);
+			}
+		}
+
+		std::vector<int> expected_from_ranges;
+
+		for (int x = 1; x <= static_cast<int>(vectors[i].size()); x++)
+		{
+			if (present.count(x) == 0)
+			{
+				expected_from_ranges.push_back(x);
+			}
+		}
+
+		std::vector<int> nums = vectors[i];
+
+		bool passed = std::equal(expected_missing.begin(), expected_missing.end(), missing.begin() + i * k)
+			&& (missing_from_ranges == expected_from_ranges)
+			&& (missing[i * k] == first_missing_positive(nums));
+
+		// Adjacent ranges would mean a run was split.
+		for (std::size_t r = offsets[i] + 1; passed && r < offsets[i + 1]; r++)
+		{
+			passed = (ranges[r].first > ranges[r - 1].last + 1);
+		}
+
+		if (!passed)
+		{
+			std::cout << "test_missing_ranges failed for input " << i << std::endl;
+			return;
+		}
+	}
+
+	std::cout << "test_missing_ranges passed" << std::endl;
+}
+
+void benchmark_missing_ranges_batch()
+{
+	std::size_t const num_vectors = 10000;
+	std::size_t const size = 1000;
+	std::size_t const k = 16;
+	int const num_batches = 20;
+
+	std::vector<std::vector<int> > vectors;
+	std::vector<IntSpan> inputs;
+
+	for (std::size_t i = 0; i < num_vectors; i++)
+	{
+		vectors.push_back(make_random_input(size, static_cast<unsigned>(i)));
+	}
+
+	for (std::vector<int> const& nums : vectors)
+	{
+		inputs.push_back({ nums.data(), nums.size() });
+	}
+
+	MissingScratch scratch;
+	std::vector<GapRange> ranges;
+	std::vector<std::size_t> offsets;
+	std::vector<int> missing;
+
+	// The first batch grows the buffers, the timed ones reuse them.
+	missing_ranges_batch(inputs, scratch, ranges, offsets);
+	k_smallest_missing_batch(inputs, k, scratch, missing);
+
+	GapRange const* ranges_data = ranges.data();
+	int const* missing_data = missing.data();
+
+	double ms_ranges = time_ms([&]() {
+		for (int batch = 0; batch < num_batches; batch++)
+		{
+			missing_ranges_batch(inputs, scratch, ranges, offsets);
+		}
+	});
+
+	double ms_missing = time_ms([&]() {
+		for (int batch = 0; batch < num_batches; batch++)
+		{
+			k_smallest_missing_batch(inputs, k, scratch, missing);
+		}
+	});
+
+	bool reused = (ranges.data() == ranges_data) && (missing.data() == missing_data);
+
+	std::cout << std::setprecision(0) << std::fixed;
+	std::cout << "benchmark_missing_ranges_batch (" << num_vectors << " vectors of " << size << ")" << std::endl;
+	std::cout << "\tmissing_ranges_batch      : " << num_batches * num_vectors / (ms_ranges / 1000.0) << " vectors/s" << std::endl;
+	std::cout << "\tk_smallest_missing_batch  : " << num_batches * num_vectors / (ms_missing / 1000.0) << " vectors/s (k = " << k << ")" << std::endl;
+	std::cout << "\tbuffers reused            : " << reused << std::endl;
+}
@@ -47,7 +47,628 @@
  */
 
 #include <iostream>
+#include <iomanip>
 #include <vector>
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <thread>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <fstream>
+#include <list>
+#include <unordered_map>
+#include <cstdio>
+#include <type_traits>
+
+#ifdef __SSE2__
+#include <immintrin.h>
+#endif
+
+/*
+ * A range of columns [ left, right ] of 'row' that still has to be searched
+ * for pixels of the old color. The row it was found from is 'row - dy'.
+ */
+struct Span
+{
+	int row;
+	int left;
+	int right;
+	int dy;
+};
+
+/*
+ * A run of pixels on columns [ left, right ] of 'row'.
+ */
+struct Run
+{
+	int row;
+	int left;
+	int right;
+};
+
+/*
+ * A view of an image in a single buffer that the caller owns, e.g. a
+ * memory-mapped raw frame. Row r starts at data + r * stride; the stride
+ * is in pixels, and may be larger than the width when rows are padded.
+ * 'Pixel' is the pixel type, e.g. std::uint8_t, std::uint16_t or
+ * std::uint32_t.
+ */
+template <typename Pixel>
+struct ImageView
+{
+	typedef Pixel pixel_type;
+
+	Pixel * data;
+	int width;
+	int height;
+	std::ptrdiff_t stride;
+
+	int num_rows() const
+	{
+		return height;
+	}
+
+	int row_width(int) const
+	{
+		return width;
+	}
+
+	Pixel * row(int r) const
+	{
+		return data + r * stride;
+	}
+};
+
+/*
+ * The same interface as ImageView, over the nested vectors that
+ * 'flood_fill' takes. Each row keeps its own width.
+ */
+struct NestedImage
+{
+	typedef int pixel_type;
+
+	std::vector<std::vector<int> > & image;
+
+	int num_rows() const
+	{
+		return static_cast<int>(image.size());
+	}
+
+	int row_width(int r) const
+	{
+		return static_cast<int>(image[r].size());
+	}
+
+	int * row(int r) const
+	{
+		return image[r].data();
+	}
+};
+
+/*
+ * What a fill changed: the number of pixels filled, and the rows and
+ * columns of their bounding box. The box is only meaningful when
+ * 'num_filled' is not 0.
+ */
+struct FillResult
+{
+	std::size_t num_filled = 0;
+	int min_row = 0;
+	int min_col = 0;
+	int max_row = -1;
+	int max_col = -1;
+};
+
+/*
+ * The instruction sets the run kernels below can use. SSE2 is part of
+ * every x86-64 CPU; AVX2 is checked for at run time.
+ */
+enum class SimdLevel
+{
+	scalar,
+	sse2,
+	avx2
+};
+
+SimdLevel best_simd_level();
+char const* simd_level_name(SimdLevel level);
+
+/*
+ * The kernels the scanline fill spends its time in, for pixels of type
+ * 'Lane' (std::uint8_t, std::uint16_t or std::uint32_t). Each works on
+ * the columns [ col, end ) of a row.
+ */
+template <typename Lane>
+struct RunKernels
+{
+	// The first column whose pixel is 'color', or 'end'.
+	int (*find_equal)(Lane const* row, int col, int end, Lane color);
+
+	// The first column whose pixel is not 'color', or 'end'.
+	int (*find_not_equal)(Lane const* row, int col, int end, Lane color);
+
+	// The first column of the run of 'color' that ends right before 'col',
+	// i.e. 'col' itself when row[col - 1] is not 'color'.
+	int (*find_run_start)(Lane const* row, int col, Lane color);
+
+	void (*fill)(Lane * row, int col, int end, Lane color);
+};
+
+template <typename Lane>
+RunKernels<Lane> run_kernels(SimdLevel level);
+
+template <typename Lane>
+RunKernels<Lane> const& best_run_kernels();
+
+template <typename Pixel>
+int scalar_find_equal(Pixel const* row, int col, int end, Pixel color);
+
+template <typename Pixel>
+int scalar_find_not_equal(Pixel const* row, int col, int end, Pixel color);
+
+template <typename Pixel>
+int scalar_find_run_start(Pixel const* row, int col, Pixel color);
+
+template <typename Pixel>
+void scalar_fill(Pixel * row, int col, int end, Pixel color);
+
+/*
+ * The lane type of the pixel types that have vector kernels. Signed
+ * pixels are compared as the unsigned type of the same size.
+ */
+template <typename Pixel>
+struct SimdLane
+{
+};
+
+template <> struct SimdLane<std::uint8_t> { typedef std::uint8_t type; };
+template <> struct SimdLane<std::int8_t> { typedef std::uint8_t type; };
+template <> struct SimdLane<std::uint16_t> { typedef std::uint16_t type; };
+template <> struct SimdLane<std::int16_t> { typedef std::uint16_t type; };
+template <> struct SimdLane<std::uint32_t> { typedef std::uint32_t type; };
+template <> struct SimdLane<std::int32_t> { typedef std::uint32_t type; };
+
+template <typename T>
+struct make_void
+{
+	typedef void type;
+};
+
+/*
+ * How 'scanline_fill' searches rows and fills runs: one pixel at a time
+ * for any pixel type, and with the best kernels for the CPU for those
+ * that have a lane type.
+ */
+template <typename Pixel, typename = void>
+struct RunScanner
+{
+	int find_equal(Pixel const* row, int col, int end, Pixel color) const
+	{
+		return scalar_find_equal(row, col, end, color);
+	}
+
+	int find_not_equal(Pixel const* row, int col, int end, Pixel color) const
+	{
+		return scalar_find_not_equal(row, col, end, color);
+	}
+
+	int find_run_start(Pixel const* row, int col, Pixel color) const
+	{
+		return scalar_find_run_start(row, col, color);
+	}
+
+	void fill(Pixel * row, int col, int end, Pixel color) const
+	{
+		scalar_fill(row, col, end, color);
+	}
+};
+
+/*
+ * Most runs of a noisy image are a few pixels long, so the first few
+ * pixels are looked at here before paying for a call to a kernel.
+ */
+template <typename Pixel>
+struct RunScanner<Pixel, typename make_void<typename SimdLane<Pixel>::type>::type>
+{
+	typedef typename SimdLane<Pixel>::type Lane;
+
+	static int const num_inline_pixels = 4;
+
+	RunKernels<Lane> const& kernels = best_run_kernels<Lane>();
+
+	int find_equal(Pixel const* row, int col, int end, Pixel color) const
+	{
+		for (int stop = std::min(end, col + num_inline_pixels); col < stop; col++)
+		{
+			if (row[col] == color)
+			{
+				return col;
+			}
+		}
+
+		return col < end ? kernels.find_equal(reinterpret_cast<Lane const*>(row), col, end, static_cast<Lane>(color)) : end;
+	}
+
+	int find_not_equal(Pixel const* row, int col, int end, Pixel color) const
+	{
+		for (int stop = std::min(end, col + num_inline_pixels); col < stop; col++)
+		{
+			if (row[col] != color)
+			{
+				return col;
+			}
+		}
+
+		return col < end ? kernels.find_not_equal(reinterpret_cast<Lane const*>(row), col, end, static_cast<Lane>(color)) : end;
+	}
+
+	int find_run_start(Pixel const* row, int col, Pixel color) const
+	{
+		for (int stop = std::max(0, col - num_inline_pixels); col > stop; col--)
+		{
+			if (row[col - 1] != color)
+			{
+				return col;
+			}
+		}
+
+		return col > 0 ? kernels.find_run_start(reinterpret_cast<Lane const*>(row), col, static_cast<Lane>(color)) : 0;
+	}
+
+	void fill(Pixel * row, int col, int end, Pixel color) const
+	{
+		if (end - col <= num_inline_pixels)
+		{
+			std::fill(row + col, row + end, color);
+			return;
+		}
+
+		kernels.fill(reinterpret_cast<Lane *>(row), col, end, static_cast<Lane>(color));
+	}
+};
+
+template <typename Image>
+FillResult scanline_fill(
+	Image const& image,
+	int sr,
+	int sc,
+	typename Image::pixel_type new_color,
+	std::vector<Span> & stack);
+
+template <typename Image, typename OnRun>
+FillResult scanline_fill(
+	Image const& image,
+	int sr,
+	int sc,
+	typename Image::pixel_type new_color,
+	std::vector<Span> & stack,
+	OnRun on_run);
+
+template <typename Pixel>
+FillResult flood_fill_in_place(
+	ImageView<Pixel> image,
+	int sr,
+	int sc,
+	Pixel new_color,
+	std::vector<Span> & stack);
+
+/*
+ * An undo and redo history of the fills made to an image, for an editor.
+ * Each fill is journaled as the runs it changed and the one color they
+ * had, so undoing or redoing it costs as much as the fill changed, and
+ * its bounding box is what needs to be redrawn. Making a new fill drops
+ * the fills that were undone.
+ *
+ * 'Image' is an ImageView or a NestedImage. The image must only be
+ * changed through the history while it is in use.
+ */
+template <typename Image>
+class FillHistory
+{
+public:
+	typedef typename Image::pixel_type Pixel;
+
+	explicit FillHistory(Image const& image)
+		: image(image)
+	{
+	}
+
+	FillResult fill(int sr, int sc, Pixel new_color);
+
+	// Each returns false when there is nothing to undo or redo, and
+	// otherwise sets 'changes' to what it changed.
+	bool undo(FillResult & changes);
+	bool redo(FillResult & changes);
+
+	std::size_t num_undoable() const
+	{
+		return num_applied;
+	}
+
+	std::size_t num_redoable() const
+	{
+		return edits.size() - num_applied;
+	}
+
+	// The memory held by the journal, in bytes.
+	std::size_t journal_bytes() const
+	{
+		return edits.capacity() * sizeof(Edit) + runs.capacity() * sizeof(Run);
+	}
+
+private:
+	// A fill, which changed runs[ first_run, first_run + num_runs ) from
+	// 'old_color' to 'new_color'.
+	struct Edit
+	{
+		Pixel old_color;
+		Pixel new_color;
+		std::size_t first_run;
+		std::size_t num_runs;
+		FillResult changes;
+	};
+
+	void paint(Edit const& edit, Pixel color);
+
+	Image image;
+	std::vector<Span> stack;
+
+	std::vector<Edit> edits;
+	std::vector<Run> runs;
+	std::size_t num_applied = 0;
+};
+
+/*
+ * The connected components of an image, i.e. the regions that
+ * 'flood_fill' would fill, computed once so that filling from a seed
+ * becomes recoloring a known list of pixels.
+ *
+ * The image is labeled in parallel: each thread runs a union-find over
+ * the pixels of its own band of rows, the bands are then joined along
+ * their borders, and the labels are made dense. The pixels of each
+ * component are then listed as horizontal runs, grouped by label, so
+ * that a recolor is a sequence of row fills.
+ *
+ * After a recolor, a component has to be merged with the neighbouring
+ * components of its new color, as a later fill would cross into them.
+ * That second union-find works on components rather than pixels, and
+ * keeps, for each group of merged components, the list of its members
+ * and of its neighbours. The runs of a merged group are sorted and
+ * joined the next time it is recolored, so that a region made of many
+ * small components is then filled with a few long runs.
+ *
+ * The image must only be changed through 'recolor' while the labeling
+ * is in use.
+ */
+template <typename Pixel>
+class ComponentLabeling
+{
+public:
+	ComponentLabeling(ImageView<Pixel> image, unsigned num_threads = std::thread::hardware_concurrency());
+
+	// Does what a flood fill of 'new_color' from (sr, sc) would do.
+	// Returns the number of pixels recolored.
+	std::size_t recolor(int sr, int sc, Pixel new_color);
+
+	std::size_t num_components() const
+	{
+		return component_offsets.size() - 1;
+	}
+
+private:
+	// What a group gathers from the groups merged into it.
+	struct MergedLists
+	{
+		std::vector<int> members;
+		std::vector<Run> runs;
+		std::vector<int> neighbours;
+	};
+
+	int find_group(int component);
+	MergedLists & merged_lists(int group);
+	void join_runs(int group);
+
+	template <typename Function>
+	void for_each_run(int group, Function function);
+
+	ImageView<Pixel> image;
+
+	// The component of each pixel, by index row * width + col.
+	std::vector<int> pixel_components;
+
+	// The runs of component i are
+	// component_runs[ component_offsets[i], component_offsets[i + 1] ),
+	// and its neighbours
+	// component_neighbours[ neighbour_offsets[i], neighbour_offsets[i + 1] ).
+	std::vector<std::size_t> component_offsets;
+	std::vector<Run> component_runs;
+	std::vector<std::size_t> neighbour_offsets;
+	std::vector<int> component_neighbours;
+
+	// Whether the runs, and the neighbours, of a component have been
+	// moved to the merged lists of its group.
+	std::vector<bool> runs_moved;
+	std::vector<bool> neighbours_moved;
+
+	// The groups of components merged by recolors, indexed by their root.
+	// Only the groups that have been merged have lists, as most of the
+	// components of a noisy image never are.
+	std::vector<int> group_parent;
+	std::vector<Pixel> group_color;
+	std::vector<std::size_t> group_sizes;
+	std::vector<int> group_lists;
+	std::vector<MergedLists> lists;
+};
+
+/*
+ * The header of a tiled raster file. The tiles follow it in row-major
+ * order, each a full tile_width x tile_height block of pixels stored
+ * row by row; the tiles on the right and bottom edges are padded.
+ */
+struct TiledRasterHeader
+{
+	char magic[4];
+	std::uint32_t pixel_size;
+	std::int32_t width;
+	std::int32_t height;
+	std::int32_t tile_width;
+	std::int32_t tile_height;
+};
+
+/*
+ * What the tile cache of a 'TiledRaster' did, to tune the tile size
+ * and the number of resident tiles.
+ */
+struct TileCacheStats
+{
+	std::size_t tile_loads = 0;
+	std::size_t tile_evictions = 0;
+	std::size_t tile_writebacks = 0;
+	std::size_t bytes_read = 0;
+	std::size_t bytes_written = 0;
+};
+
+/*
+ * A raster file too large to load, of which at most 'max_resident_tiles'
+ * tiles are kept in memory. The least recently used tile is evicted to
+ * make room, and written back if it was changed.
+ *
+ * The tiles are read and written with std::fstream rather than mapped,
+ * so that the number of resident tiles is bounded by this cache and not
+ * left to the page cache.
+ */
+template <typename Pixel>
+class TiledRaster
+{
+public:
+	bool open(std::string const& path, std::size_t max_resident_tiles);
+
+	// Writes the changed resident tiles back to the file.
+	bool flush();
+
+	// The pixels of a tile, loading it if needed, or nullptr if it could
+	// not be read. The pointer is valid until the next call to 'tile'.
+	Pixel * tile(int tile_index);
+
+	void mark_dirty(int tile_index);
+	bool is_resident(int tile_index) const;
+
+	// The tile that the last call to 'tile' evicted, or -1.
+	int last_evicted() const
+	{
+		return evicted_tile;
+	}
+
+	int tile_at(int row, int col) const
+	{
+		return (row / header.tile_height) * num_tile_cols + col / header.tile_width;
+	}
+
+	int width() const { return header.width; }
+	int height() const { return header.height; }
+	int tile_width() const { return header.tile_width; }
+	int tile_height() const { return header.tile_height; }
+	int num_tiles() const { return num_tile_cols * num_tile_rows; }
+
+	TileCacheStats const& stats() const
+	{
+		return cache_stats;
+	}
+
+private:
+	struct Slot
+	{
+		int tile_index;
+		bool dirty;
+		std::vector<Pixel> pixels;
+		std::list<int>::iterator lru_position;
+	};
+
+	bool write_back(Slot & slot);
+
+	std::fstream file;
+	TiledRasterHeader header;
+	int num_tile_cols = 0;
+	int num_tile_rows = 0;
+	std::size_t max_slots = 0;
+
+	// The slot of each tile, or -1 when it is not resident.
+	std::vector<int> tile_slots;
+	std::vector<Slot> slots;
+
+	// The slots, the most recently used first.
+	std::list<int> lru;
+	int evicted_tile = -1;
+
+	TileCacheStats cache_stats;
+};
+
+/*
+ * The outcome of 'flood_fill_tiled'. 'num_handoffs' counts the spans
+ * queued for another tile than the one they were found from.
+ */
+struct TiledFillResult
+{
+	bool ok = false;
+	FillResult fill;
+	std::size_t num_handoffs = 0;
+};
+
+template <typename Pixel>
+TiledFillResult flood_fill_tiled(TiledRaster<Pixel> & raster, int sr, int sc, Pixel new_color);
+
+/*
+ * A batch of spans that a thread of 'flood_fill_parallel' sends to the
+ * owner of their tiles.
+ */
+struct SpanBatch
+{
+	std::vector<Span> spans;
+	SpanBatch * next;
+};
+
+/*
+ * The inbox of a thread of 'flood_fill_parallel': a lock-free stack that
+ * any thread can push batches to, and that its owner empties all at once.
+ */
+class SpanInbox
+{
+public:
+	void push(SpanBatch * batch)
+	{
+		batch->next = head.load(std::memory_order_relaxed);
+
+		while (!head.compare_exchange_weak(batch->next, batch, std::memory_order_release, std::memory_order_relaxed))
+		{
+		}
+	}
+
+	SpanBatch * take_all()
+	{
+		return head.exchange(nullptr, std::memory_order_acquire);
+	}
+
+private:
+	std::atomic<SpanBatch *> head { nullptr };
+};
+
+template <typename Pixel>
+FillResult flood_fill_parallel(
+	ImageView<Pixel> image,
+	int sr,
+	int sc,
+	Pixel new_color,
+	unsigned num_threads = std::thread::hardware_concurrency(),
+	int tile_size = 1024);
+
+template <typename Pixel, typename PixelAt>
+bool write_tiled_raster(std::string const& path, int width, int height, int tile_width, int tile_height, PixelAt pixel_at);
+
+template <typename Pixel>
+bool read_tiled_raster(std::string const& path, std::vector<std::vector<int> > & image);
 
 std::vector<std::vector<int> > flood_fill(
 	std::vector<std::vector<int> > & image,
@@ -62,8 +683,38 @@ void flood_fill_helper(
 	int col_index,
 	int new_color);
 
+FillResult flood_fill_scanline(
+	std::vector<std::vector<int> > & image,
+	int sr,
+	int sc,
+	int new_color,
+	std::vector<Span> & stack);
+
 void print(std::vector<std::vector<int> > const& image);
 
+std::vector<std::vector<int> > make_random_image(int rows, int cols, int num_colors, unsigned seed);
+std::vector<std::vector<int> > make_spiral_image(int size);
+std::vector<std::vector<int> > make_checkerboard_image(int rows, int cols);
+
+template <typename Function>
+double time_ms(Function function);
+
+void test_flood_fill_scanline();
+void benchmark_flood_fill_scanline();
+void test_flood_fill_in_place();
+void benchmark_flood_fill_in_place();
+void test_component_labeling();
+void time_component_labeling(std::string const& name, std::vector<std::vector<int> > const& nested, int num_colors, int num_seeds);
+void benchmark_component_labeling();
+void test_run_kernels();
+void benchmark_run_kernels();
+void test_flood_fill_tiled();
+void benchmark_flood_fill_tiled();
+void test_fill_history();
+void benchmark_fill_history();
+void test_flood_fill_parallel();
+void benchmark_flood_fill_parallel();
+
 int main()
 {
 	std::cout << "before:" << std::endl;
@@ -94,6 +745,34 @@ int main()
 	std::cout << "after:" << std::endl;
 	print(image);
 
+	test_flood_fill_scanline();
+
+	benchmark_flood_fill_scanline();
+
+	test_flood_fill_in_place();
+
+	benchmark_flood_fill_in_place();
+
+	test_component_labeling();
+
+	benchmark_component_labeling();
+
+	test_run_kernels();
+
+	benchmark_run_kernels();
+
+	test_flood_fill_tiled();
+
+	benchmark_flood_fill_tiled();
+
+	test_fill_history();
+
+	benchmark_fill_history();
+
+	test_flood_fill_parallel();
+
+	benchmark_flood_fill_parallel();
+
 	return 0;
 }
 
@@ -103,9 +782,11 @@ std::vector<std::vector<int> > flood_fill(
 	int sc,
 	int new_color)
 {
-	if (!image.empty() && image[sr][sc] != new_color)
+	if (!image.empty())
 	{
-		flood_fill_helper(image, sr, sc, new_color);
+		std::vector<Span> stack;
+
+		flood_fill_scanline(image, sr, sc, new_color, stack);
 	}
 
 	return image;
@@ -128,13 +809,13 @@ void flood_fill_helper(
         }
         
         // Go east, if possible.
-        if (col_index + 1 < image[row_index].size() && image[row_index][col_index + 1] == old_color)
+        if (col_index + 1 < static_cast<int>(image[row_index].size()) && image[row_index][col_index + 1] == old_color)
         {
             flood_fill_helper(image, row_index, col_index + 1, new_color);
         }
         
         // Go south, if possible.
-        if (row_index + 1 < image.size() && image[row_index + 1][col_index] == old_color)
+        if (row_index + 1 < static_cast<int>(image.size()) && image[row_index + 1][col_index] == old_color)
         {
             flood_fill_helper(image, row_index + 1, col_index, new_color);
         }
@@ -146,21 +827,2692 @@ void flood_fill_helper(
         }
 }
 
-void print(std::vector<std::vector<int> > const& image)
+/*
+ * This solution fills whole horizontal runs of the old color at once,
+ * instead of recursing once per pixel, so its memory does not grow with
+ * the depth of a region and it makes no call per pixel.
+ *
+ * Each span on 'stack' is a range of a row to search for runs. Filling a
+ * run found from a span of row r - dy queues the same range of the next
+ * row, r + dy. The row it came from was already searched over the span,
+ * so only the parts of the run that stick out past the span are queued
+ * back towards it. 'stack' is cleared first, and can be reused across
+ * calls to save its allocations.
+ *
+ * 'Image' is an ImageView or a NestedImage. The fill is done in place.
+ * 'on_run(row, left, right)' is called for each run filled, i.e. the
+ * pixels on columns [ left, right ] of 'row' that were 'old_color'.
+ */
+template <typename Image, typename OnRun>
+FillResult scanline_fill(
+	Image const& image,
+	int sr,
+	int sc,
+	typename Image::pixel_type new_color,
+	std::vector<Span> & stack,
+	OnRun on_run)
+{
+	typedef typename Image::pixel_type Pixel;
+
+	FillResult result;
+
+	Pixel const old_color = image.row(sr)[sc];
+
+	if (old_color == new_color)
+	{
+		return result;
+	}
+
+	int const num_rows = image.num_rows();
+
+	RunScanner<Pixel> const scanner;
+
+	result.min_row = sr;
+	result.max_row = sr;
+	result.min_col = sc;
+	result.max_col = sc;
+
+	stack.clear();
+
+	// The seed row, and the row above it with the seed row as its origin.
+	stack.push_back({ sr, sc, sc, 1 });
+	stack.push_back({ sr - 1, sc, sc, -1 });
+
+	while (!stack.empty())
+	{
+		Span span = stack.back();
+		stack.pop_back();
+
+		if (span.row < 0 || span.row >= num_rows)
+		{
+			continue;
+		}
+
+		Pixel * row = image.row(span.row);
+
+		int const width = image.row_width(span.row);
+		int const last = std::min(span.right, width - 1);
+
+		int col = span.left;
+
+		while (col <= last)
+		{
+			col = scanner.find_equal(row, col, last + 1, old_color);
+
+			if (col > last)
+			{
+				break;
+			}
+
+			int run_left = scanner.find_run_start(row, col, old_color);
+			int run_right = scanner.find_not_equal(row, col + 1, width, old_color) - 1;
+
+			scanner.fill(row, run_left, run_right + 1, new_color);
+			on_run(span.row, run_left, run_right);
+
+			result.num_filled += run_right - run_left + 1;
+			result.min_row = std::min(result.min_row, span.row);
+			result.max_row = std::max(result.max_row, span.row);
+			result.min_col = std::min(result.min_col, run_left);
+			result.max_col = std::max(result.max_col, run_right);
+
+			stack.push_back({ span.row + span.dy, run_left, run_right, span.dy });
+
+			if (run_left < span.left)
+			{
+				stack.push_back({ span.row - span.dy, run_left, span.left - 1, -span.dy });
+			}
+
+			if (run_right > span.right)
+			{
+				stack.push_back({ span.row - span.dy, span.right + 1, run_right, -span.dy });
+			}
+
+			// The pixel right after the run is not of the old color.
+			col = run_right + 2;
+		}
+	}
+
+	return result;
+}
+
+template <typename Image>
+FillResult scanline_fill(
+	Image const& image,
+	int sr,
+	int sc,
+	typename Image::pixel_type new_color,
+	std::vector<Span> & stack)
+{
+	return scanline_fill(image, sr, sc, new_color, stack, [](int, int, int) {});
+}
+
+template <typename Image>
+FillResult FillHistory<Image>::fill(int sr, int sc, Pixel new_color)
+{
+	// A fill that changes nothing keeps the fills that can be redone.
+	if (image.row(sr)[sc] == new_color)
+	{
+		return FillResult();
+	}
+
+	// Otherwise, it replaces them.
+	if (num_applied < edits.size())
+	{
+		runs.resize(edits[num_applied].first_run);
+		edits.resize(num_applied);
+	}
+
+	Edit edit;
+	edit.old_color = image.row(sr)[sc];
+	edit.new_color = new_color;
+	edit.first_run = runs.size();
+
+	std::vector<Run> & journal = runs;
+
+	edit.changes = scanline_fill(image, sr, sc, new_color, stack, [&journal](int row, int left, int right) {
+		journal.push_back({ row, left, right });
+	});
+
+	edit.num_runs = runs.size() - edit.first_run;
+
+	edits.push_back(edit);
+	num_applied++;
+
+	return edit.changes;
+}
+
+template <typename Image>
+void FillHistory<Image>::paint(Edit const& edit, Pixel color)
+{
+	for (std::size_t i = edit.first_run; i < edit.first_run + edit.num_runs; i++)
+	{
+		Pixel * row = image.row(runs[i].row);
+		std::fill(row + runs[i].left, row + runs[i].right + 1, color);
+	}
+}
+
+template <typename Image>
+bool FillHistory<Image>::undo(FillResult & changes)
+{
+	if (num_applied == 0)
+	{
+		return false;
+	}
+
+	Edit const& edit = edits[--num_applied];
+	paint(edit, edit.old_color);
+	changes = edit.changes;
+
+	return true;
+}
+
+template <typename Image>
+bool FillHistory<Image>::redo(FillResult & changes)
+{
+	if (num_applied == edits.size())
+	{
+		return false;
+	}
+
+	Edit const& edit = edits[num_applied++];
+	paint(edit, edit.new_color);
+	changes = edit.changes;
+
+	return true;
+}
+
+/*
+ * The adapter of 'scanline_fill' for the nested vectors of 'flood_fill'.
+ */
+FillResult flood_fill_scanline(
+	std::vector<std::vector<int> > & image,
+	int sr,
+	int sc,
+	int new_color,
+	std::vector<Span> & stack)
+{
+	return scanline_fill(NestedImage { image }, sr, sc, new_color, stack);
+}
+
+/*
+ * Fills an image in the caller's buffer, without copying it, and returns
+ * only what changed instead of the whole image.
+ */
+template <typename Pixel>
+FillResult flood_fill_in_place(
+	ImageView<Pixel> image,
+	int sr,
+	int sc,
+	Pixel new_color,
+	std::vector<Span> & stack)
+{
+	return scanline_fill(image, sr, sc, new_color, stack);
+}
+
+template <typename Pixel>
+int scalar_find_equal(Pixel const* row, int col, int end, Pixel color)
+{
+	while (col < end && row[col] != color)
+	{
+		col++;
+	}
+
+	return col;
+}
+
+template <typename Pixel>
+int scalar_find_not_equal(Pixel const* row, int col, int end, Pixel color)
+{
+	while (col < end && row[col] == color)
+	{
+		col++;
+	}
+
+	return col;
+}
+
+template <typename Pixel>
+int scalar_find_run_start(Pixel const* row, int col, Pixel color)
+{
+	while (col > 0 && row[col - 1] == color)
+	{
+		col--;
+	}
+
+	return col;
+}
+
+template <typename Pixel>
+void scalar_fill(Pixel * row, int col, int end, Pixel color)
+{
+	std::fill(row + col, row + end, color);
+}
+
+#ifdef __SSE2__
+
+/*
+ * The SSE2 and AVX2 kernels compare a full register of pixels at a time.
+ * The byte mask of the comparison has sizeof(Lane) bits per pixel, so
+ * the index of its first (or last) set bit, divided by sizeof(Lane), is
+ * the pixel the search stops at. The columns that do not fill a
+ * register are left to the scalar kernels.
+ */
+inline __m128i sse2_broadcast(std::uint8_t color)
+{
+	return _mm_set1_epi8(static_cast<char>(color));
+}
+
+inline __m128i sse2_broadcast(std::uint16_t color)
+{
+	return _mm_set1_epi16(static_cast<short>(color));
+}
+
+inline __m128i sse2_broadcast(std::uint32_t color)
+{
+	return _mm_set1_epi32(static_cast<int>(color));
+}
+
+inline unsigned sse2_equal_mask(__m128i pixels, __m128i color, std::uint8_t)
+{
+	return static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(pixels, color)));
+}
+
+inline unsigned sse2_equal_mask(__m128i pixels, __m128i color, std::uint16_t)
+{
+	return static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi16(pixels, color)));
+}
+
+inline unsigned sse2_equal_mask(__m128i pixels, __m128i color, std::uint32_t)
+{
+	return static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi32(pixels, color)));
+}
+
+template <typename Lane, bool Equal>
+int sse2_find(Lane const* row, int col, int end, Lane color)
+{
+	int const num_lanes = 16 / sizeof(Lane);
+	__m128i const target = sse2_broadcast(color);
+
+	for (; col + num_lanes <= end; col += num_lanes)
+	{
+		__m128i pixels = _mm_loadu_si128(reinterpret_cast<__m128i const*>(row + col));
+		unsigned mask = sse2_equal_mask(pixels, target, Lane());
+
+		if (!Equal)
+		{
+			mask ^= 0xFFFFu;
+		}
+
+		if (mask)
+		{
+			return col + static_cast<int>(__builtin_ctz(mask) / sizeof(Lane));
+		}
+	}
+
+	return Equal ? scalar_find_equal(row, col, end, color) : scalar_find_not_equal(row, col, end, color);
+}
+
+template <typename Lane>
+int sse2_find_equal(Lane const* row, int col, int end, Lane color)
+{
+	return sse2_find<Lane, true>(row, col, end, color);
+}
+
+template <typename Lane>
+int sse2_find_not_equal(Lane const* row, int col, int end, Lane color)
+{
+	return sse2_find<Lane, false>(row, col, end, color);
+}
+
+template <typename Lane>
+int sse2_find_run_start(Lane const* row, int col, Lane color)
+{
+	int const num_lanes = 16 / sizeof(Lane);
+	__m128i const target = sse2_broadcast(color);
+
+	for (; col >= num_lanes; col -= num_lanes)
+	{
+		__m128i pixels = _mm_loadu_si128(reinterpret_cast<__m128i const*>(row + col - num_lanes));
+		unsigned mask = sse2_equal_mask(pixels, target, Lane()) ^ 0xFFFFu;
+
+		if (mask)
+		{
+			return col - num_lanes + static_cast<int>((31 - __builtin_clz(mask)) / sizeof(Lane)) + 1;
+		}
+	}
+
+	return scalar_find_run_start(row, col, color);
+}
+
+template <typename Lane>
+void sse2_fill(Lane * row, int col, int end, Lane color)
+{
+	int const num_lanes = 16 / sizeof(Lane);
+	__m128i const pixels = sse2_broadcast(color);
+
+	// For bytes, std::fill is a memset, which is already faster.
+	if (sizeof(Lane) == 1)
+	{
+		scalar_fill(row, col, end, color);
+		return;
+	}
+
+	for (; col + num_lanes <= end; col += num_lanes)
+	{
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(row + col), pixels);
+	}
+
+	scalar_fill(row, col, end, color);
+}
+
+__attribute__((target("avx2"))) inline __m256i avx2_broadcast(std::uint8_t color)
+{
+	return _mm256_set1_epi8(static_cast<char>(color));
+}
+
+__attribute__((target("avx2"))) inline __m256i avx2_broadcast(std::uint16_t color)
+{
+	return _mm256_set1_epi16(static_cast<short>(color));
+}
+
+__attribute__((target("avx2"))) inline __m256i avx2_broadcast(std::uint32_t color)
+{
+	return _mm256_set1_epi32(static_cast<int>(color));
+}
+
+__attribute__((target("avx2"))) inline unsigned avx2_equal_mask(__m256i pixels, __m256i color, std::uint8_t)
+{
+	return static_cast<unsigned>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(pixels, color)));
+}
+
+__attribute__((target("avx2"))) inline unsigned avx2_equal_mask(__m256i pixels, __m256i color, std::uint16_t)
+{
+	return static_cast<unsigned>(_mm256_movemask_epi8(_mm256_cmpeq_epi16(pixels, color)));
+}
+
+__attribute__((target("avx2"))) inline unsigned avx2_equal_mask(__m256i pixels, __m256i color, std::uint32_t)
+{
+	return static_cast<unsigned>(_mm256_movemask_epi8(_mm256_cmpeq_epi32(pixels, color)));
+}
+
+template <typename Lane, bool Equal>
+__attribute__((target("avx2"))) int avx2_find(Lane const* row, int col, int end, Lane color)
+{
+	int const num_lanes = 32 / sizeof(Lane);
+	__m256i const target = avx2_broadcast(color);
+
+	for (; col + num_lanes <= end; col += num_lanes)
+	{
+		__m256i pixels = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(row + col));
+		unsigned mask = avx2_equal_mask(pixels, target, Lane());
+
+		if (!Equal)
+		{
+			mask = ~mask;
+		}
+
+		if (mask)
+		{
+			return col + static_cast<int>(__builtin_ctz(mask) / sizeof(Lane));
+		}
+	}
+
+	return Equal ? scalar_find_equal(row, col, end, color) : scalar_find_not_equal(row, col, end, color);
+}
+
+template <typename Lane>
+__attribute__((target("avx2"))) int avx2_find_equal(Lane const* row, int col, int end, Lane color)
+{
+	return avx2_find<Lane, true>(row, col, end, color);
+}
+
+template <typename Lane>
+__attribute__((target("avx2"))) int avx2_find_not_equal(Lane const* row, int col, int end, Lane color)
+{
+	return avx2_find<Lane, false>(row, col, end, color);
+}
+
+template <typename Lane>
+__attribute__((target("avx2"))) int avx2_find_run_start(Lane const* row, int col, Lane color)
+{
+	int const num_lanes = 32 / sizeof(Lane);
+	__m256i const target = avx2_broadcast(color);
+
+	for (; col >= num_lanes; col -= num_lanes)
+	{
+		__m256i pixels = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(row + col - num_lanes));
+		unsigned mask = ~avx2_equal_mask(pixels, target, Lane());
+
+		if (mask)
+		{
+			return col - num_lanes + static_cast<int>((31 - __builtin_clz(mask)) / sizeof(Lane)) + 1;
+		}
+	}
+
+	return scalar_find_run_start(row, col, color);
+}
+
+template <typename Lane>
+__attribute__((target("avx2"))) void avx2_fill(Lane * row, int col, int end, Lane color)
+{
+	int const num_lanes = 32 / sizeof(Lane);
+	__m256i const pixels = avx2_broadcast(color);
+
+	if (sizeof(Lane) == 1)
+	{
+		scalar_fill(row, col, end, color);
+		return;
+	}
+
+	for (; col + num_lanes <= end; col += num_lanes)
+	{
+		_mm256_storeu_si256(reinterpret_cast<__m256i *>(row + col), pixels);
+	}
+
+	scalar_fill(row, col, end, color);
+}
+
+#endif
+
+SimdLevel best_simd_level()
+{
+#ifdef __SSE2__
+	if (__builtin_cpu_supports("avx2"))
+	{
+		return SimdLevel::avx2;
+	}
+
+	return SimdLevel::sse2;
+#else
+	return SimdLevel::scalar;
+#endif
+}
+
+char const* simd_level_name(SimdLevel level)
+{
+	switch (level)
+	{
+	case SimdLevel::sse2:
+		return "sse2";
+	case SimdLevel::avx2:
+		return "avx2";
+	default:
+		return "scalar";
+	}
+}
+
+/*
+ * The kernels for 'level', or for the best level the CPU has when it
+ * does not have 'level'.
+ */
+template <typename Lane>
+RunKernels<Lane> run_kernels(SimdLevel level)
+{
+	level = std::min(level, best_simd_level());
+
+#ifdef __SSE2__
+	if (level == SimdLevel::avx2)
+	{
+		return { avx2_find_equal<Lane>, avx2_find_not_equal<Lane>, avx2_find_run_start<Lane>, avx2_fill<Lane> };
+	}
+
+	if (level == SimdLevel::sse2)
+	{
+		return { sse2_find_equal<Lane>, sse2_find_not_equal<Lane>, sse2_find_run_start<Lane>, sse2_fill<Lane> };
+	}
+#endif
+
+	return { scalar_find_equal<Lane>, scalar_find_not_equal<Lane>, scalar_find_run_start<Lane>, scalar_fill<Lane> };
+}
+
+template <typename Lane>
+RunKernels<Lane> const& best_run_kernels()
+{
+	static RunKernels<Lane> const kernels = run_kernels<Lane>(best_simd_level());
+
+	return kernels;
+}
+
+/*
+ * Returns the root of 'pixel' in a union-find whose roots are always the
+ * smallest index of their set, halving the path on the way.
+ */
+inline int find_root(std::vector<int> & parent, int pixel)
+{
+	while (parent[pixel] != pixel)
+	{
+		parent[pixel] = parent[parent[pixel]];
+		pixel = parent[pixel];
+	}
+
+	return pixel;
+}
+
+/*
+ * Joins the sets of 'a' and 'b', under the smaller of their roots.
+ */
+inline void unite(std::vector<int> & parent, int a, int b)
+{
+	a = find_root(parent, a);
+	b = find_root(parent, b);
+
+	if (a < b)
+	{
+		parent[b] = a;
+	}
+	else if (b < a)
+	{
+		parent[a] = b;
+	}
+}
+
+template <typename Pixel>
+ComponentLabeling<Pixel>::ComponentLabeling(ImageView<Pixel> image, unsigned num_threads)
+	: image(image)
+{
+	int const width = image.width;
+	int const height = image.height;
+	std::size_t const num_pixels = static_cast<std::size_t>(width) * height;
+
+	if (num_threads == 0)
+	{
+		num_threads = 1;
+	}
+
+	num_threads = std::min<unsigned>(num_threads, std::max(height, 1));
+
+	std::vector<int> & parent = pixel_components;
+	parent.resize(num_pixels);
+
+	// Each thread links the pixels of its band to their left and upper
+	// neighbours of the same color. Roots are the smallest index of their
+	// set, so a band only ever writes to its own pixels.
+	std::vector<std::thread> threads;
+
+	for (unsigned t = 0; t < num_threads; t++)
+	{
+		int first_row = static_cast<int>(static_cast<long>(height) * t / num_threads);
+		int end_row = static_cast<int>(static_cast<long>(height) * (t + 1) / num_threads);
+
+		threads.emplace_back([&parent, image, width, first_row, end_row]() {
+			for (int r = first_row; r < end_row; r++)
+			{
+				Pixel const* row = image.row(r);
+
+				for (int c = 0; c < width; c++)
+				{
+					int pixel = r * width + c;
+					parent[pixel] = pixel;
+
+					if (c > 0 && row[c - 1] == row[c])
+					{
+						unite(parent, pixel, pixel - 1);
+					}
+
+					if (r > first_row && image.row(r - 1)[c] == row[c])
+					{
+						unite(parent, pixel, pixel - width);
+					}
+				}
+			}
+		});
+	}
+
+	for (std::thread & thread : threads)
+	{
+		thread.join();
+	}
+
+	// Join the bands along their borders.
+	for (unsigned t = 1; t < num_threads; t++)
+	{
+		int r = static_cast<int>(static_cast<long>(height) * t / num_threads);
+
+		for (int c = 0; c < width; c++)
+		{
+			if (image.row(r - 1)[c] == image.row(r)[c])
+			{
+				unite(parent, r * width + c, (r - 1) * width + c);
+			}
+		}
+	}
+
+	// Every parent has a smaller index than its child, so in index order,
+	// the parent of a pixel already holds its dense component number.
+	int num_labels = 0;
+
+	for (std::size_t pixel = 0; pixel < num_pixels; pixel++)
+	{
+		int p = parent[pixel];
+		parent[pixel] = (p == static_cast<int>(pixel)) ? num_labels++ : parent[p];
+	}
+
+	// List the runs, and the neighbours, of each component with counting
+	// sorts. A neighbour is listed once for each run boundary it shares.
+	component_offsets.assign(num_labels + 1, 0);
+	neighbour_offsets.assign(num_labels + 1, 0);
+	group_sizes.assign(num_labels, 0);
+
+	for (int r = 0; r < height; r++)
+	{
+		int const* components = &pixel_components[static_cast<std::size_t>(r) * width];
+		int const* below = (r + 1 < height) ? components + width : nullptr;
+
+		for (int c = 0; c < width; c++)
+		{
+			group_sizes[components[c]]++;
+
+			if (c == 0 || components[c - 1] != components[c])
+			{
+				component_offsets[components[c] + 1]++;
+			}
+
+			if (c + 1 < width && components[c + 1] != components[c])
+			{
+				neighbour_offsets[components[c] + 1]++;
+				neighbour_offsets[components[c + 1] + 1]++;
+			}
+
+			if (below && below[c] != components[c] && (c == 0 || below[c - 1] != below[c] || components[c - 1] != components[c]))
+			{
+				neighbour_offsets[components[c] + 1]++;
+				neighbour_offsets[below[c] + 1]++;
+			}
+		}
+	}
+
+	for (int i = 0; i < num_labels; i++)
+	{
+		component_offsets[i + 1] += component_offsets[i];
+		neighbour_offsets[i + 1] += neighbour_offsets[i];
+	}
+
+	component_runs.resize(component_offsets[num_labels]);
+	component_neighbours.resize(neighbour_offsets[num_labels]);
+
+	std::vector<std::size_t> next_run(component_offsets.begin(), component_offsets.end() - 1);
+	std::vector<std::size_t> next_neighbour(neighbour_offsets.begin(), neighbour_offsets.end() - 1);
+
+	for (int r = 0; r < height; r++)
+	{
+		int const* components = &pixel_components[static_cast<std::size_t>(r) * width];
+		int const* below = (r + 1 < height) ? components + width : nullptr;
+
+		for (int c = 0; c < width; c++)
+		{
+			if (c == 0 || components[c - 1] != components[c])
+			{
+				int right = c;
+
+				while (right + 1 < width && components[right + 1] == components[c])
+				{
+					right++;
+				}
+
+				component_runs[next_run[components[c]]++] = { r, c, right };
+			}
+
+			if (c + 1 < width && components[c + 1] != components[c])
+			{
+				component_neighbours[next_neighbour[components[c]]++] = components[c + 1];
+				component_neighbours[next_neighbour[components[c + 1]]++] = components[c];
+			}
+
+			if (below && below[c] != components[c] && (c == 0 || below[c - 1] != below[c] || components[c - 1] != components[c]))
+			{
+				component_neighbours[next_neighbour[components[c]]++] = below[c];
+				component_neighbours[next_neighbour[below[c]]++] = components[c];
+			}
+		}
+	}
+
+	runs_moved.assign(num_labels, false);
+	neighbours_moved.assign(num_labels, false);
+
+	// Each component starts as a group of its own.
+	group_parent.resize(num_labels);
+	group_color.resize(num_labels);
+	group_lists.assign(num_labels, -1);
+
+	for (int i = 0; i < num_labels; i++)
+	{
+		Run const& run = component_runs[component_offsets[i]];
+
+		group_parent[i] = i;
+		group_color[i] = image.row(run.row)[run.left];
+	}
+}
+
+template <typename Pixel>
+int ComponentLabeling<Pixel>::find_group(int component)
+{
+	while (group_parent[component] != component)
+	{
+		group_parent[component] = group_parent[group_parent[component]];
+		component = group_parent[component];
+	}
+
+	return component;
+}
+
+template <typename Pixel>
+typename ComponentLabeling<Pixel>::MergedLists & ComponentLabeling<Pixel>::merged_lists(int group)
+{
+	if (group_lists[group] < 0)
+	{
+		group_lists[group] = static_cast<int>(lists.size());
+		lists.emplace_back();
+	}
+
+	return lists[group_lists[group]];
+}
+
+/*
+ * Calls 'function' on each run of 'group': those of its root component,
+ * unless they have been moved, then those of the members merged into it,
+ * then its own joined runs.
+ */
+template <typename Pixel>
+template <typename Function>
+void ComponentLabeling<Pixel>::for_each_run(int group, Function function)
+{
+	if (!runs_moved[group])
+	{
+		for (std::size_t i = component_offsets[group]; i < component_offsets[group + 1]; i++)
+		{
+			function(component_runs[i]);
+		}
+	}
+
+	if (group_lists[group] < 0)
+	{
+		return;
+	}
+
+	MergedLists const& merged = lists[group_lists[group]];
+
+	for (int const& member : merged.members)
+	{
+		for (std::size_t i = component_offsets[member]; i < component_offsets[member + 1]; i++)
+		{
+			function(component_runs[i]);
+		}
+	}
+
+	for (Run const& run : merged.runs)
+	{
+		function(run);
+	}
+}
+
+/*
+ * Replaces the runs of a merged group by a single sorted list, in which
+ * the runs that touch on a row are joined.
+ */
+template <typename Pixel>
+void ComponentLabeling<Pixel>::join_runs(int group)
+{
+	std::vector<Run> runs;
+
+	for_each_run(group, [&runs](Run const& run) { runs.push_back(run); });
+
+	MergedLists & merged = merged_lists(group);
+	merged.members.clear();
+	runs_moved[group] = true;
+
+	std::sort(runs.begin(), runs.end(), [](Run const& a, Run const& b) {
+		return a.row < b.row || (a.row == b.row && a.left < b.left);
+	});
+
+	std::size_t num_joined = 0;
+
+	for (std::size_t i = 1; i < runs.size(); i++)
+	{
+		if (runs[i].row == runs[num_joined].row && runs[i].left == runs[num_joined].right + 1)
+		{
+			runs[num_joined].right = runs[i].right;
+		}
+		else
+		{
+			runs[++num_joined] = runs[i];
+		}
+	}
+
+	runs.resize(std::min(runs.size(), num_joined + 1));
+	merged.runs.swap(runs);
+}
+
+template <typename Pixel>
+std::size_t ComponentLabeling<Pixel>::recolor(int sr, int sc, Pixel new_color)
+{
+	int group = find_group(pixel_components[sr * image.width + sc]);
+
+	if (group_color[group] == new_color)
+	{
+		return 0;
+	}
+
+	if (group_lists[group] >= 0)
+	{
+		MergedLists const& merged = lists[group_lists[group]];
+
+		if (!runs_moved[group] + merged.members.size() + !merged.runs.empty() > 1)
+		{
+			join_runs(group);
+		}
+	}
+
+	ImageView<Pixel> const& view = image;
+
+	for_each_run(group, [&view, new_color](Run const& run) {
+		Pixel * row = view.row(run.row);
+		std::fill(row + run.left, row + run.right + 1, new_color);
+	});
+
+	group_color[group] = new_color;
+
+	// Merge with the neighbours that now have the same color. Neighbour
+	// entries are only ever moved, the shorter list into the longer one,
+	// and the stale ones are dropped here.
+	std::vector<int> neighbours;
+	std::vector<int> merged_groups;
+
+	if (group_lists[group] >= 0)
+	{
+		neighbours.swap(lists[group_lists[group]].neighbours);
+	}
+
+	if (!neighbours_moved[group])
+	{
+		neighbours.insert(neighbours.end(),
+			component_neighbours.begin() + neighbour_offsets[group],
+			component_neighbours.begin() + neighbour_offsets[group + 1]);
+		neighbours_moved[group] = true;
+	}
+
+	std::size_t num_kept = 0;
+
+	for (std::size_t i = 0; i < neighbours.size(); i++)
+	{
+		int other = find_group(neighbours[i]);
+
+		if (other == group)
+		{
+			continue;
+		}
+
+		if (group_color[other] != new_color)
+		{
+			neighbours[num_kept++] = neighbours[i];
+			continue;
+		}
+
+		group_parent[other] = group;
+		group_sizes[group] += group_sizes[other];
+		merged_groups.push_back(other);
+	}
+
+	neighbours.resize(num_kept);
+
+	if (merged_groups.empty())
+	{
+		if (!neighbours.empty())
+		{
+			merged_lists(group).neighbours.swap(neighbours);
+		}
+
+		return group_sizes[group];
+	}
+
+	std::size_t num_recolored = group_sizes[group];
+
+	for (int const& other : merged_groups)
+	{
+		num_recolored -= group_sizes[other];
+	}
+
+	MergedLists & merged = merged_lists(group);
+	merged.neighbours.swap(neighbours);
+
+	for (int const& other : merged_groups)
+	{
+		if (!runs_moved[other])
+		{
+			merged.members.push_back(other);
+			runs_moved[other] = true;
+		}
+
+		if (!neighbours_moved[other])
+		{
+			merged.neighbours.insert(merged.neighbours.end(),
+				component_neighbours.begin() + neighbour_offsets[other],
+				component_neighbours.begin() + neighbour_offsets[other + 1]);
+			neighbours_moved[other] = true;
+		}
+
+		if (group_lists[other] < 0)
+		{
+			continue;
+		}
+
+		MergedLists & other_lists = lists[group_lists[other]];
+
+		if (other_lists.members.size() > merged.members.size())
+		{
+			merged.members.swap(other_lists.members);
+		}
+
+		merged.members.insert(merged.members.end(), other_lists.members.begin(), other_lists.members.end());
+
+		if (other_lists.runs.size() > merged.runs.size())
+		{
+			merged.runs.swap(other_lists.runs);
+		}
+
+		merged.runs.insert(merged.runs.end(), other_lists.runs.begin(), other_lists.runs.end());
+
+		if (other_lists.neighbours.size() > merged.neighbours.size())
+		{
+			merged.neighbours.swap(other_lists.neighbours);
+		}
+
+		merged.neighbours.insert(merged.neighbours.end(), other_lists.neighbours.begin(), other_lists.neighbours.end());
+
+		other_lists = MergedLists();
+	}
+
+	return num_recolored;
+}
+
+template <typename Pixel>
+bool TiledRaster<Pixel>::open(std::string const& path, std::size_t max_resident_tiles)
+{
+	file.open(path, std::ios::in | std::ios::out | std::ios::binary);
+
+	if (!file.read(reinterpret_cast<char *>(&header), sizeof(header))
+		|| std::string(header.magic, 4) != "TILE"
+		|| header.pixel_size != sizeof(Pixel)
+		|| header.width <= 0 || header.height <= 0
+		|| header.tile_width <= 0 || header.tile_height <= 0
+		|| max_resident_tiles == 0)
+	{
+		return false;
+	}
+
+	num_tile_cols = (header.width + header.tile_width - 1) / header.tile_width;
+	num_tile_rows = (header.height + header.tile_height - 1) / header.tile_height;
+	max_slots = max_resident_tiles;
+
+	tile_slots.assign(num_tiles(), -1);
+
+	return true;
+}
+
+template <typename Pixel>
+bool TiledRaster<Pixel>::write_back(Slot & slot)
+{
+	std::size_t tile_bytes = slot.pixels.size() * sizeof(Pixel);
+
+	file.seekp(sizeof(header) + static_cast<std::streamoff>(slot.tile_index) * tile_bytes);
+
+	if (!file.write(reinterpret_cast<char const*>(slot.pixels.data()), tile_bytes))
+	{
+		return false;
+	}
+
+	slot.dirty = false;
+	cache_stats.tile_writebacks++;
+	cache_stats.bytes_written += tile_bytes;
+
+	return true;
+}
+
+template <typename Pixel>
+bool TiledRaster<Pixel>::flush()
+{
+	for (Slot & slot : slots)
+	{
+		if (slot.dirty && !write_back(slot))
+		{
+			return false;
+		}
+	}
+
+	return static_cast<bool>(file.flush());
+}
+
+template <typename Pixel>
+Pixel * TiledRaster<Pixel>::tile(int tile_index)
+{
+	int slot_index = tile_slots[tile_index];
+
+	evicted_tile = -1;
+
+	if (slot_index >= 0)
+	{
+		Slot & slot = slots[slot_index];
+		lru.splice(lru.begin(), lru, slot.lru_position);
+
+		return slot.pixels.data();
+	}
+
+	if (slots.size() < max_slots)
+	{
+		slot_index = static_cast<int>(slots.size());
+		slots.push_back({ -1, false, std::vector<Pixel>(static_cast<std::size_t>(header.tile_width) * header.tile_height), lru.end() });
+		lru.push_front(slot_index);
+	}
+	else
+	{
+		slot_index = lru.back();
+		lru.splice(lru.begin(), lru, std::prev(lru.end()));
+
+		Slot & evicted = slots[slot_index];
+
+		if (evicted.dirty && !write_back(evicted))
+		{
+			return nullptr;
+		}
+
+		tile_slots[evicted.tile_index] = -1;
+		evicted_tile = evicted.tile_index;
+		evicted.tile_index = -1;
+		cache_stats.tile_evictions++;
+	}
+
+	Slot & slot = slots[slot_index];
+	slot.lru_position = lru.begin();
+
+	std::size_t tile_bytes = slot.pixels.size() * sizeof(Pixel);
+
+	file.seekg(sizeof(header) + static_cast<std::streamoff>(tile_index) * tile_bytes);
+
+	if (!file.read(reinterpret_cast<char *>(slot.pixels.data()), tile_bytes))
+	{
+		return nullptr;
+	}
+
+	slot.tile_index = tile_index;
+	slot.dirty = false;
+	tile_slots[tile_index] = slot_index;
+	cache_stats.tile_loads++;
+	cache_stats.bytes_read += tile_bytes;
+
+	return slot.pixels.data();
+}
+
+template <typename Pixel>
+void TiledRaster<Pixel>::mark_dirty(int tile_index)
+{
+	slots[tile_slots[tile_index]].dirty = true;
+}
+
+template <typename Pixel>
+bool TiledRaster<Pixel>::is_resident(int tile_index) const
+{
+	return tile_slots[tile_index] >= 0;
+}
+
+/*
+ * Fills the runs of 'old_color' found from 'span', in a tile whose columns
+ * are [ col0, col0 + num_cols ) of an image 'width' pixels wide. 'row'
+ * points to column col0 of the span's row. Runs stop at the edges of the
+ * tile: push(row, left, right, dy) is called with the spans to search
+ * next, and push_across(row, col) with the pixels across the left or
+ * right edge that a run reached. A span with 'dy' 0 has no origin row,
+ * and is searched both up and down. Returns whether anything was filled.
+ */
+template <typename Pixel, typename Push, typename PushAcross>
+bool fill_span_in_tile(
+	Span const& span,
+	Pixel * row,
+	int col0,
+	int num_cols,
+	int width,
+	Pixel old_color,
+	Pixel new_color,
+	RunScanner<Pixel> const& scanner,
+	FillResult & fill,
+	Push push,
+	PushAcross push_across)
+{
+	bool changed = false;
+
+	int const last = span.right - col0;
+	int col = span.left - col0;
+
+	while (col <= last)
+	{
+		col = scanner.find_equal(row, col, last + 1, old_color);
+
+		if (col > last)
+		{
+			break;
+		}
+
+		int run_left = scanner.find_run_start(row, col, old_color);
+		int run_right = scanner.find_not_equal(row, col + 1, num_cols, old_color) - 1;
+
+		scanner.fill(row, run_left, run_right + 1, new_color);
+		changed = true;
+
+		int const left = col0 + run_left;
+		int const right = col0 + run_right;
+
+		fill.num_filled += run_right - run_left + 1;
+		fill.min_row = std::min(fill.min_row, span.row);
+		fill.max_row = std::max(fill.max_row, span.row);
+		fill.min_col = std::min(fill.min_col, left);
+		fill.max_col = std::max(fill.max_col, right);
+
+		if (span.dy == 0)
+		{
+			push(span.row - 1, left, right, -1);
+			push(span.row + 1, left, right, 1);
+		}
+		else
+		{
+			push(span.row + span.dy, left, right, span.dy);
+
+			if (left < span.left)
+			{
+				push(span.row - span.dy, left, span.left - 1, -span.dy);
+			}
+
+			if (right > span.right)
+			{
+				push(span.row - span.dy, span.right + 1, right, -span.dy);
+			}
+		}
+
+		if (run_left == 0 && col0 > 0)
+		{
+			push_across(span.row, col0 - 1);
+		}
+
+		if (run_right == num_cols - 1 && col0 + num_cols < width)
+		{
+			push_across(span.row, col0 + num_cols);
+		}
+
+		// The pixel right after the run is not of the old color.
+		col = run_right + 2;
+	}
+
+	return changed;
+}
+
+/*
+ * The scanline fill of 'scanline_fill', one tile at a time. Each pending
+ * tile has a queue of the spans that other tiles found for it, kept in a
+ * map so that memory follows the tiles the fill reaches and not the size
+ * of the raster. A tile is loaded, filled from its queue until the spans
+ * left all belong to other tiles, and the next tile to fill is one that
+ * is still resident when there is one, so that tiles are loaded again as
+ * little as possible.
+ *
+ * The pending tiles are on two stacks, resident or not, as they were when
+ * pushed: a tile goes on one when its queue is created, and on the second
+ * one when it is evicted while pending. Only the tile being filled is ever
+ * loaded, so a tile on the second stack stays there until taken. An entry
+ * whose queue is gone, or a tile on the first stack that was evicted since,
+ * is stale and dropped when reached, so picking a tile takes amortized
+ * constant time.
+ */
+template <typename Pixel>
+TiledFillResult flood_fill_tiled(TiledRaster<Pixel> & raster, int sr, int sc, Pixel new_color)
+{
+	TiledFillResult result;
+	FillResult & fill = result.fill;
+
+	int const width = raster.width();
+	int const height = raster.height();
+	int const tile_width = raster.tile_width();
+	int const tile_height = raster.tile_height();
+
+	int const seed_tile = raster.tile_at(sr, sc);
+	Pixel const* seed_pixels = raster.tile(seed_tile);
+
+	if (!seed_pixels)
+	{
+		return result;
+	}
+
+	Pixel const old_color = seed_pixels[(sr % tile_height) * tile_width + sc % tile_width];
+
+	result.ok = true;
+
+	if (old_color == new_color)
+	{
+		return result;
+	}
+
+	fill.min_row = sr;
+	fill.max_row = sr;
+	fill.min_col = sc;
+	fill.max_col = sc;
+
+	RunScanner<Pixel> const scanner;
+
+	std::unordered_map<int, std::vector<Span> > queues;
+	std::vector<int> resident_pending;
+	std::vector<int> evicted_pending;
+	std::vector<Span> stack;
+
+	// The spans handed off in a row mostly go to the same tile, so the last
+	// queue used is kept. The map's nodes do not move, so it stays valid
+	// until a queue is erased.
+	int last_tile = -1;
+	std::vector<Span> * last_queue = nullptr;
+
+	auto queue_span = [&](int tile_index, Span span) {
+		if (tile_index != last_tile)
+		{
+			last_tile = tile_index;
+			last_queue = &queues[tile_index];
+		}
+
+		if (last_queue->empty())
+		{
+			(raster.is_resident(tile_index) ? resident_pending : evicted_pending).push_back(tile_index);
+		}
+
+		last_queue->push_back(span);
+	};
+
+	// Prefer a tile that is still resident, then the last one queued.
+	auto next_tile = [&]() {
+		while (!resident_pending.empty())
+		{
+			int tile_index = resident_pending.back();
+			resident_pending.pop_back();
+
+			if (queues.count(tile_index) != 0 && raster.is_resident(tile_index))
+			{
+				return tile_index;
+			}
+		}
+
+		while (!evicted_pending.empty())
+		{
+			int tile_index = evicted_pending.back();
+			evicted_pending.pop_back();
+
+			if (queues.count(tile_index) != 0)
+			{
+				return tile_index;
+			}
+		}
+
+		return -1;
+	};
+
+	queue_span(seed_tile, { sr, sc, sc, 0 });
+
+	for (int tile_index = next_tile(); tile_index >= 0; tile_index = next_tile())
+	{
+		Pixel * pixels = raster.tile(tile_index);
+
+		if (!pixels)
+		{
+			result.ok = false;
+			return result;
+		}
+
+		int const evicted = raster.last_evicted();
+
+		if (evicted >= 0 && queues.count(evicted) != 0)
+		{
+			evicted_pending.push_back(evicted);
+		}
+
+		int const row0 = (tile_index / ((width + tile_width - 1) / tile_width)) * tile_height;
+		int const col0 = (tile_index % ((width + tile_width - 1) / tile_width)) * tile_width;
+		int const num_rows = std::min(tile_height, height - row0);
+		int const num_cols = std::min(tile_width, width - col0);
+
+		bool changed = false;
+
+		std::unordered_map<int, std::vector<Span> >::iterator queue = queues.find(tile_index);
+
+		stack.clear();
+		stack.swap(queue->second);
+		queues.erase(queue);
+		last_tile = -1;
+
+		// Queues a span on the tile of its row, which has the same columns.
+		auto push = [&](int row, int left, int right, int dy) {
+			if (row < 0 || row >= height)
+			{
+				return;
+			}
+
+			if (row >= row0 && row < row0 + num_rows)
+			{
+				stack.push_back({ row, left, right, dy });
+				return;
+			}
+
+			queue_span(raster.tile_at(row, left), { row, left, right, dy });
+			result.num_handoffs++;
+		};
+
+		auto push_across = [&](int row, int col) {
+			queue_span(raster.tile_at(row, col), { row, col, col, 0 });
+			result.num_handoffs++;
+		};
+
+		while (!stack.empty())
+		{
+			Span span = stack.back();
+			stack.pop_back();
+
+			Pixel * row = pixels + static_cast<std::size_t>(span.row - row0) * tile_width;
+
+			changed |= fill_span_in_tile(span, row, col0, num_cols, width, old_color, new_color, scanner, fill, push, push_across);
+		}
+
+		if (changed)
+		{
+			raster.mark_dirty(tile_index);
+		}
+	}
+
+	return result;
+}
+
+/*
+ * A flood fill of one region by several threads. The image is cut into
+ * square tiles, dealt out to the threads in turn, and only the owner of
+ * a tile reads or writes its pixels. A thread fills the spans of its own
+ * tiles from a local stack, with runs that only stop at the tiles of
+ * other threads, and sends the spans that belong to those tiles to their
+ * owners' inboxes, in batches.
+ *
+ * 'outstanding' counts the spans that were sent and are not done yet: a
+ * thread adds the spans of a batch before sending it, and only takes the
+ * spans it received off the count once it has filled all they led to
+ * and sent its own batches. So the count is only 0 once there is no work
+ * left anywhere, and the threads stop then.
+ */
+template <typename Pixel>
+FillResult flood_fill_parallel(
+	ImageView<Pixel> image,
+	int sr,
+	int sc,
+	Pixel new_color,
+	unsigned num_threads,
+	int tile_size)
+{
+	FillResult result;
+
+	Pixel const old_color = image.row(sr)[sc];
+
+	if (old_color == new_color)
+	{
+		return result;
+	}
+
+	num_threads = std::max(num_threads, 1u);
+
+	int const num_tile_cols = (image.width + tile_size - 1) / tile_size;
+
+	auto owner_of = [num_tile_cols, tile_size, num_threads](int row, int col) {
+		return static_cast<unsigned>(((row / tile_size) * num_tile_cols + col / tile_size) % num_threads);
+	};
+
+	// Tiles next to each other on a row have different owners, unless a
+	// single thread owns them all. Runs stop at the edges of these widths.
+	int const owned_width = (num_threads == 1) ? image.width : tile_size;
+
+	std::unique_ptr<SpanInbox[]> inboxes(new SpanInbox[num_threads]);
+	std::atomic<std::size_t> outstanding(1);
+
+	inboxes[owner_of(sr, sc)].push(new SpanBatch { { { sr, sc, sc, 0 } }, nullptr });
+
+	// Every region contains its seed, so the boxes of all threads start
+	// from it.
+	result.min_row = sr;
+	result.max_row = sr;
+	result.min_col = sc;
+	result.max_col = sc;
+
+	std::vector<FillResult> results(num_threads, result);
+
+	auto worker = [&](unsigned thread) {
+		std::size_t const batch_size = 64;
+
+		RunScanner<Pixel> const scanner;
+		FillResult & fill = results[thread];
+
+		std::vector<Span> stack;
+		std::vector<std::vector<Span> > outgoing(num_threads);
+
+		auto send = [&](unsigned owner) {
+			outstanding.fetch_add(outgoing[owner].size(), std::memory_order_relaxed);
+			inboxes[owner].push(new SpanBatch { std::move(outgoing[owner]), nullptr });
+			outgoing[owner].clear();
+		};
+
+		// Cuts a span into the pieces owned by each thread.
+		auto push = [&](int row, int left, int right, int dy) {
+			if (row < 0 || row >= image.height)
+			{
+				return;
+			}
+
+			while (left <= right)
+			{
+				unsigned owner = owner_of(row, left);
+				int end = std::min((left / owned_width + 1) * owned_width - 1, right);
+
+				if (owner == thread)
+				{
+					stack.push_back({ row, left, end, dy });
+				}
+				else
+				{
+					outgoing[owner].push_back({ row, left, end, dy });
+
+					if (outgoing[owner].size() >= batch_size)
+					{
+						send(owner);
+					}
+				}
+
+				left = end + 1;
+			}
+		};
+
+		auto push_across = [&](int row, int col) {
+			push(row, col, col, 0);
+		};
+
+		while (true)
+		{
+			SpanBatch * batch = inboxes[thread].take_all();
+
+			if (!batch)
+			{
+				if (outstanding.load(std::memory_order_acquire) == 0)
+				{
+					break;
+				}
+
+				std::this_thread::yield();
+				continue;
+			}
+
+			std::size_t num_received = 0;
+
+			while (batch)
+			{
+				SpanBatch * next = batch->next;
+				stack.insert(stack.end(), batch->spans.begin(), batch->spans.end());
+				num_received += batch->spans.size();
+				delete batch;
+				batch = next;
+			}
+
+			while (!stack.empty())
+			{
+				Span span = stack.back();
+				stack.pop_back();
+
+				int const col0 = (span.left / owned_width) * owned_width;
+				int const num_cols = std::min(owned_width, image.width - col0);
+
+				fill_span_in_tile(span, image.row(span.row) + col0, col0, num_cols, image.width,
+					old_color, new_color, scanner, fill, push, push_across);
+			}
+
+			for (unsigned owner = 0; owner < num_threads; owner++)
+			{
+				if (!outgoing[owner].empty())
+				{
+					send(owner);
+				}
+			}
+
+			outstanding.fetch_sub(num_received, std::memory_order_acq_rel);
+		}
+	};
+
+	std::vector<std::thread> threads;
+
+	for (unsigned thread = 1; thread < num_threads; thread++)
+	{
+		threads.emplace_back(worker, thread);
+	}
+
+	worker(0);
+
+	for (std::thread & thread : threads)
+	{
+		thread.join();
+	}
+
+	for (FillResult const& fill : results)
+	{
+		result.num_filled += fill.num_filled;
+		result.min_row = std::min(result.min_row, fill.min_row);
+		result.max_row = std::max(result.max_row, fill.max_row);
+		result.min_col = std::min(result.min_col, fill.min_col);
+		result.max_col = std::max(result.max_col, fill.max_col);
+	}
+
+	return result;
+}
+
+/*
+ * Writes a tiled raster of 'width' x 'height' pixels, where the pixel
+ * at (r, c) is pixel_at(r, c), one tile at a time.
+ */
+template <typename Pixel, typename PixelAt>
+bool write_tiled_raster(std::string const& path, int width, int height, int tile_width, int tile_height, PixelAt pixel_at)
+{
+	std::ofstream out(path, std::ios::binary | std::ios::trunc);
+
+	TiledRasterHeader header = { { 'T', 'I', 'L', 'E' }, sizeof(Pixel), width, height, tile_width, tile_height };
+
+	out.write(reinterpret_cast<char const*>(&header), sizeof(header));
+
+	std::vector<Pixel> tile(static_cast<std::size_t>(tile_width) * tile_height);
+
+	for (int row0 = 0; row0 < height; row0 += tile_height)
+	{
+		for (int col0 = 0; col0 < width; col0 += tile_width)
+		{
+			for (int r = 0; r < tile_height; r++)
+			{
+				for (int c = 0; c < tile_width; c++)
+				{
+					bool inside = row0 + r < height && col0 + c < width;
+					tile[static_cast<std::size_t>(r) * tile_width + c] = inside ? static_cast<Pixel>(pixel_at(row0 + r, col0 + c)) : Pixel();
+				}
+			}
+
+			out.write(reinterpret_cast<char const*>(tile.data()), tile.size() * sizeof(Pixel));
+		}
+	}
+
+	return static_cast<bool>(out);
+}
+
+/*
+ * Reads a whole tiled raster into nested vectors, for checking.
+ */
+template <typename Pixel>
+bool read_tiled_raster(std::string const& path, std::vector<std::vector<int> > & image)
+{
+	TiledRaster<Pixel> raster;
+
+	if (!raster.open(path, 1))
+	{
+		return false;
+	}
+
+	image.assign(raster.height(), std::vector<int>(raster.width()));
+
+	for (int r = 0; r < raster.height(); r++)
+	{
+		for (int c = 0; c < raster.width(); c++)
+		{
+			Pixel const* pixels = raster.tile(raster.tile_at(r, c));
+
+			if (!pixels)
+			{
+				return false;
+			}
+
+			image[r][c] = pixels[(r % raster.tile_height()) * raster.tile_width() + c % raster.tile_width()];
+		}
+	}
+
+	return true;
+}
+
+void print(std::vector<std::vector<int> > const& image)
 {
 	std::cout << "{" << std::endl;
 
-	for (std::vector<int> const& vec : image)
+	for (std::vector<int> const& vec : image)
+	{
+		std::cout << "\t{ ";
+
+		for (int const& i : vec)
+		{
+			std::cout << i << ", ";
+		}
+
+		std::cout << "}," << std::endl;
+	}
+
+	std::cout << "}" << std::endl << std::endl;
+}
+
+std::vector<std::vector<int> > make_random_image(int rows, int cols, int num_colors, unsigned seed)
+{
+	std::vector<std::vector<int> > image(rows, std::vector<int>(cols));
+
+	for (std::vector<int> & row : image)
+	{
+		for (int & pixel : row)
+		{
+			seed = seed * 1103515245 + 12345;
+			pixel = static_cast<int>((seed >> 16) % num_colors);
+		}
+	}
+
+	return image;
+}
+
+/*
+ * A square spiral corridor of 0's between walls of 1's. Filling from the
+ * outer end of the corridor, at (0, 0), walks the whole spiral.
+ */
+std::vector<std::vector<int> > make_spiral_image(int size)
+{
+	std::vector<std::vector<int> > image(size, std::vector<int>(size, 1));
+
+	int const row_steps[] = { 0, 1, 0, -1 };
+	int const col_steps[] = { 1, 0, -1, 0 };
+
+	int row = 0;
+	int col = 0;
+	int direction = 0;
+	int num_turns = 0;
+
+	image[0][0] = 0;
+
+	// Carve two pixels at a time, and turn right when the corridor would
+	// run out of the image or into itself. Two turns in a row mean that
+	// the center has been reached.
+	while (num_turns < 2)
+	{
+		int next_row = row + 2 * row_steps[direction];
+		int next_col = col + 2 * col_steps[direction];
+
+		if (next_row < 0 || next_row >= size || next_col < 0 || next_col >= size || image[next_row][next_col] == 0)
+		{
+			direction = (direction + 1) % 4;
+			num_turns++;
+			continue;
+		}
+
+		image[row + row_steps[direction]][col + col_steps[direction]] = 0;
+		image[next_row][next_col] = 0;
+
+		row = next_row;
+		col = next_col;
+		num_turns = 0;
+	}
+
+	return image;
+}
+
+/*
+ * A checkerboard of 0's and 1's where every even row is all 0's. The 0's
+ * form a single region, and every odd row of it is made of 1-pixel runs,
+ * the worst case for a scanline fill.
+ */
+std::vector<std::vector<int> > make_checkerboard_image(int rows, int cols)
+{
+	std::vector<std::vector<int> > image(rows, std::vector<int>(cols));
+
+	for (int r = 0; r < rows; r++)
+	{
+		for (int c = 0; c < cols; c++)
+		{
+			image[r][c] = (r % 2 == 0 || c % 2 == 0) ? 0 : 1;
+		}
+	}
+
+	return image;
+}
+
+template <typename Function>
+double time_ms(Function function)
+{
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	function();
+
+	std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+
+	return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+void test_flood_fill_scanline()
+{
+	std::vector<Span> stack;
+
+	for (unsigned seed = 0; seed < 500; seed++)
+	{
+		int rows = 1 + seed % 23;
+		int cols = 1 + (seed * 7) % 31;
+
+		std::vector<std::vector<int> > expected = make_random_image(rows, cols, 2 + seed % 3, seed);
+		std::vector<std::vector<int> > image = expected;
+
+		int sr = static_cast<int>(seed % rows);
+		int sc = static_cast<int>((seed / 3) % cols);
+		int new_color = static_cast<int>(seed % 4);
+
+		if (expected[sr][sc] != new_color)
+		{
+			flood_fill_helper(expected, sr, sc, new_color);
+		}
+
+		flood_fill_scanline(image, sr, sc, new_color, stack);
+
+		if (image != expected)
+		{
+			std::cout << "test_flood_fill_scanline failed for seed " << seed << std::endl;
+			return;
+		}
+	}
+
+	std::vector<std::vector<int> > expected = make_spiral_image(101);
+	std::vector<std::vector<int> > image = expected;
+
+	flood_fill_helper(expected, 0, 0, 2);
+	flood_fill_scanline(image, 0, 0, 2, stack);
+
+	std::cout << "test_flood_fill_scanline " << (image == expected ? "passed" : "failed") << std::endl;
+}
+
+/*
+ * The recursive fill is only timed on images small enough for its
+ * recursion to fit on the stack.
+ */
+void benchmark_flood_fill_scanline()
+{
+	std::vector<Span> stack;
+
+	struct Case
+	{
+		char const* name;
+		std::vector<std::vector<int> > image;
+		bool recursive;
+	};
+
+	Case cases[] = {
+		{ "single color 4000x4000", std::vector<std::vector<int> >(4000, std::vector<int>(4000, 0)), false },
+		{ "single color 200x200", std::vector<std::vector<int> >(200, std::vector<int>(200, 0)), true },
+		{ "spiral 4001x4001", make_spiral_image(4001), false },
+		{ "spiral 201x201", make_spiral_image(201), true },
+		{ "checkerboard 4000x4000", make_checkerboard_image(4000, 4000), false },
+		{ "checkerboard 200x200", make_checkerboard_image(200, 200), true },
+	};
+
+	std::cout << std::setprecision(3) << std::fixed;
+	std::cout << "benchmark_flood_fill_scanline" << std::endl;
+
+	for (Case & test_case : cases)
+	{
+		std::vector<std::vector<int> > image = test_case.image;
+
+		double ms_scanline = time_ms([&]() { flood_fill_scanline(image, 0, 0, 2, stack); });
+
+		std::cout << "\t" << std::setw(24) << std::left << test_case.name << std::right
+			<< " : scanline " << ms_scanline << " ms";
+
+		if (test_case.recursive)
+		{
+			std::vector<std::vector<int> > expected = test_case.image;
+
+			double ms_recursive = time_ms([&]() { flood_fill_helper(expected, 0, 0, 2); });
+
+			std::cout << ", recursive " << ms_recursive << " ms" << (image == expected ? "" : " MISMATCH");
+		}
+
+		std::cout << std::endl;
+	}
+}
+
+/*
+ * Fills a random image through an ImageView of 'Pixel's with padded rows,
+ * and checks it against 'flood_fill_helper' on the same image as nested
+ * vectors. The padding must not be touched, and the count and box must
+ * describe exactly the pixels that changed.
+ */
+template <typename Pixel>
+bool check_flood_fill_in_place(unsigned seed, std::vector<Span> & stack)
+{
+	int rows = 1 + seed % 19;
+	int cols = 1 + (seed * 5) % 29;
+	int padding = static_cast<int>(seed % 3);
+
+	std::vector<std::vector<int> > expected = make_random_image(rows, cols, 2 + seed % 3, seed);
+	std::vector<std::vector<int> > original = expected;
+
+	std::vector<Pixel> buffer((cols + padding) * rows, Pixel(255));
+	ImageView<Pixel> view = { buffer.data(), cols, rows, cols + padding };
+
+	for (int r = 0; r < rows; r++)
+	{
+		for (int c = 0; c < cols; c++)
+		{
+			view.row(r)[c] = static_cast<Pixel>(expected[r][c]);
+		}
+	}
+
+	int sr = static_cast<int>(seed % rows);
+	int sc = static_cast<int>((seed / 7) % cols);
+	int new_color = static_cast<int>(seed % 4);
+
+	if (expected[sr][sc] != new_color)
+	{
+		flood_fill_helper(expected, sr, sc, new_color);
+	}
+
+	FillResult result = flood_fill_in_place(view, sr, sc, static_cast<Pixel>(new_color), stack);
+
+	FillResult changed;
+
+	for (int r = 0; r < rows; r++)
+	{
+		for (int c = 0; c < cols; c++)
+		{
+			if (view.row(r)[c] != static_cast<Pixel>(expected[r][c]))
+			{
+				return false;
+			}
+
+			if (expected[r][c] != original[r][c])
+			{
+				changed.min_row = (changed.num_filled == 0) ? r : std::min(changed.min_row, r);
+				changed.min_col = (changed.num_filled == 0) ? c : std::min(changed.min_col, c);
+				changed.max_row = std::max(changed.max_row, r);
+				changed.max_col = std::max(changed.max_col, c);
+				changed.num_filled++;
+			}
+		}
+
+		for (int c = cols; c < cols + padding; c++)
+		{
+			if (view.row(r)[c] != Pixel(255))
+			{
+				return false;
+			}
+		}
+	}
+
+	return (result.num_filled == changed.num_filled)
+		&& (changed.num_filled == 0
+			|| (result.min_row == changed.min_row
+				&& result.min_col == changed.min_col
+				&& result.max_row == changed.max_row
+				&& result.max_col == changed.max_col));
+}
+
+void test_flood_fill_in_place()
+{
+	std::vector<Span> stack;
+
+	for (unsigned seed = 0; seed < 300; seed++)
+	{
+		if (!check_flood_fill_in_place<std::uint8_t>(seed, stack)
+			|| !check_flood_fill_in_place<std::uint16_t>(seed, stack)
+			|| !check_flood_fill_in_place<std::uint32_t>(seed, stack))
+		{
+			std::cout << "test_flood_fill_in_place failed for seed " << seed << std::endl;
+			return;
+		}
+	}
+
+	std::cout << "test_flood_fill_in_place passed" << std::endl;
+}
+
+template <typename Pixel>
+double time_flood_fill_in_place(int size, std::vector<Span> & stack)
+{
+	std::vector<Pixel> buffer(static_cast<std::size_t>(size) * size, Pixel(0));
+	ImageView<Pixel> view = { buffer.data(), size, size, size };
+
+	return time_ms([&]() { flood_fill_in_place(view, 0, 0, Pixel(2), stack); });
+}
+
+void benchmark_flood_fill_in_place()
+{
+	int const size = 4000;
+
+	std::vector<Span> stack;
+	std::vector<std::vector<int> > image(size, std::vector<int>(size, 0));
+
+	double ms_nested = time_ms([&]() { flood_fill(image, 0, 0, 2); });
+
+	std::cout << std::setprecision(3) << std::fixed;
+	std::cout << "benchmark_flood_fill_in_place (single color " << size << "x" << size << ")" << std::endl;
+	std::cout << "\tflood_fill, nested vectors : " << ms_nested << " ms (including the returned copy)" << std::endl;
+	std::cout << "\tImageView<uint8_t>         : " << time_flood_fill_in_place<std::uint8_t>(size, stack) << " ms" << std::endl;
+	std::cout << "\tImageView<uint16_t>        : " << time_flood_fill_in_place<std::uint16_t>(size, stack) << " ms" << std::endl;
+	std::cout << "\tImageView<uint32_t>        : " << time_flood_fill_in_place<std::uint32_t>(size, stack) << " ms" << std::endl;
+}
+
+/*
+ * Runs the same random seeds through 'flood_fill_in_place' on one copy
+ * of an image, and through 'ComponentLabeling::recolor' on another.
+ */
+bool check_component_labeling(int rows, int cols, int num_colors, int num_seeds, unsigned num_threads, unsigned seed)
+{
+	std::vector<std::vector<int> > nested = make_random_image(rows, cols, num_colors, seed);
+
+	std::vector<std::uint16_t> expected_buffer;
+
+	for (std::vector<int> const& row : nested)
+	{
+		expected_buffer.insert(expected_buffer.end(), row.begin(), row.end());
+	}
+
+	std::vector<std::uint16_t> buffer = expected_buffer;
+
+	ImageView<std::uint16_t> expected_view = { expected_buffer.data(), cols, rows, cols };
+	ImageView<std::uint16_t> view = { buffer.data(), cols, rows, cols };
+
+	ComponentLabeling<std::uint16_t> labeling(view, num_threads);
+	std::vector<Span> stack;
+
+	for (int i = 0; i < num_seeds; i++)
+	{
+		seed = seed * 1103515245 + 12345;
+
+		int sr = static_cast<int>((seed >> 8) % rows);
+		int sc = static_cast<int>((seed >> 4) % cols);
+		std::uint16_t new_color = static_cast<std::uint16_t>((seed >> 16) % num_colors);
+
+		std::size_t expected = flood_fill_in_place(expected_view, sr, sc, new_color, stack).num_filled;
+
+		if (labeling.recolor(sr, sc, new_color) != expected || buffer != expected_buffer)
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+void test_component_labeling()
+{
+	for (unsigned seed = 0; seed < 100; seed++)
+	{
+		if (!check_component_labeling(1 + seed % 17, 1 + (seed * 3) % 23, 2 + seed % 3, 40, 1 + seed % 5, seed))
+		{
+			std::cout << "test_component_labeling failed for seed " << seed << std::endl;
+			return;
+		}
+	}
+
+	std::cout << "test_component_labeling passed" << std::endl;
+}
+
+void time_component_labeling(std::string const& name, std::vector<std::vector<int> > const& nested, int num_colors, int num_seeds)
+{
+	int const rows = static_cast<int>(nested.size());
+	int const cols = static_cast<int>(nested[0].size());
+
+	std::vector<std::uint32_t> flood_fill_buffer;
+
+	for (std::vector<int> const& row : nested)
+	{
+		flood_fill_buffer.insert(flood_fill_buffer.end(), row.begin(), row.end());
+	}
+
+	std::vector<std::uint32_t> labeling_buffer = flood_fill_buffer;
+
+	ImageView<std::uint32_t> flood_fill_view = { flood_fill_buffer.data(), cols, rows, cols };
+	ImageView<std::uint32_t> labeling_view = { labeling_buffer.data(), cols, rows, cols };
+
+	std::vector<int> seeds;
+	unsigned seed = 41;
+
+	for (int i = 0; i < num_seeds; i++)
+	{
+		seed = seed * 1103515245 + 12345;
+		seeds.push_back(static_cast<int>((seed >> 4) % (rows * cols)));
+	}
+
+	std::vector<Span> stack;
+
+	double ms_flood_fill = time_ms([&]() {
+		for (int i = 0; i < num_seeds; i++)
+		{
+			flood_fill_in_place(flood_fill_view, seeds[i] / cols, seeds[i] % cols, std::uint32_t(i % num_colors), stack);
+		}
+	});
+
+	std::unique_ptr<ComponentLabeling<std::uint32_t> > labeling;
+
+	double ms_labeling = time_ms([&]() { labeling.reset(new ComponentLabeling<std::uint32_t>(labeling_view)); });
+
+	double ms_recolor = time_ms([&]() {
+		for (int i = 0; i < num_seeds; i++)
+		{
+			labeling->recolor(seeds[i] / cols, seeds[i] % cols, std::uint32_t(i % num_colors));
+		}
+	});
+
+	std::cout << "\t" << name << " (" << rows << "x" << cols << ", " << num_colors << " colors, "
+		<< labeling->num_components() << " components, " << num_seeds << " seeds)" << std::endl;
+	std::cout << "\t\tflood_fill_in_place calls : " << ms_flood_fill << " ms" << std::endl;
+	std::cout << "\t\tlabeling                  : " << ms_labeling << " ms" << std::endl;
+	std::cout << "\t\trecolor calls             : " << ms_recolor << " ms"
+		<< (labeling_buffer == flood_fill_buffer ? "" : " MISMATCH") << std::endl;
+}
+
+void benchmark_component_labeling()
+{
+	int const size = 2000;
+	int const block = 40;
+	int const num_colors = 4;
+
+	std::vector<std::vector<int> > blocks = make_random_image(size / block, size / block, num_colors, 43);
+	std::vector<std::vector<int> > blocky(size, std::vector<int>(size));
+
+	for (int r = 0; r < size; r++)
 	{
-		std::cout << "\t{ ";
+		for (int c = 0; c < size; c++)
+		{
+			blocky[r][c] = blocks[r / block][c / block];
+		}
+	}
 
-		for (int const& i : vec)
+	std::cout << std::setprecision(3) << std::fixed;
+	std::cout << "benchmark_component_labeling" << std::endl;
+
+	time_component_labeling("random", make_random_image(size, size, 3, 37), 3, 10000);
+	time_component_labeling("spiral", make_spiral_image(size), 2, 200);
+	time_component_labeling("blocks", blocky, num_colors, 200);
+}
+
+/*
+ * Compares the kernels of 'level' with the scalar ones on rows made of
+ * runs of random lengths, at every column and for random ends.
+ */
+template <typename Lane>
+bool check_run_kernels(SimdLevel level, unsigned seed)
+{
+	RunKernels<Lane> const kernels = run_kernels<Lane>(level);
+
+	std::vector<Lane> row;
+
+	while (row.size() < 300)
+	{
+		seed = seed * 1103515245 + 12345;
+		row.insert(row.end(), (seed >> 8) % 70, static_cast<Lane>((seed >> 20) % 3));
+	}
+
+	int const width = static_cast<int>(row.size());
+
+	for (int col = 0; col <= width; col++)
+	{
+		seed = seed * 1103515245 + 12345;
+
+		int end = col + static_cast<int>((seed >> 8) % (width - col + 1));
+		Lane color = static_cast<Lane>((seed >> 20) % 3);
+
+		if (kernels.find_equal(row.data(), col, end, color) != scalar_find_equal(row.data(), col, end, color)
+			|| kernels.find_not_equal(row.data(), col, end, color) != scalar_find_not_equal(row.data(), col, end, color)
+			|| kernels.find_run_start(row.data(), col, color) != scalar_find_run_start(row.data(), col, color))
 		{
-			std::cout << i << ", ";
+			return false;
 		}
 
-		std::cout << "}," << std::endl;
+		std::vector<Lane> filled = row;
+		std::vector<Lane> expected = row;
+
+		kernels.fill(filled.data(), col, end, static_cast<Lane>(7));
+		scalar_fill(expected.data(), col, end, static_cast<Lane>(7));
+
+		if (filled != expected)
+		{
+			return false;
+		}
 	}
 
-	std::cout << "}" << std::endl << std::endl;
+	return true;
+}
+
+void test_run_kernels()
+{
+	SimdLevel const levels[] = { SimdLevel::scalar, SimdLevel::sse2, SimdLevel::avx2 };
+
+	for (SimdLevel level : levels)
+	{
+		if (level > best_simd_level())
+		{
+			std::cout << "test_run_kernels skipped " << simd_level_name(level) << ", which this CPU does not have" << std::endl;
+			continue;
+		}
+
+		for (unsigned seed = 0; seed < 50; seed++)
+		{
+			if (!check_run_kernels<std::uint8_t>(level, seed)
+				|| !check_run_kernels<std::uint16_t>(level, seed)
+				|| !check_run_kernels<std::uint32_t>(level, seed))
+			{
+				std::cout << "test_run_kernels failed for " << simd_level_name(level) << ", seed " << seed << std::endl;
+				return;
+			}
+		}
+	}
+
+	std::cout << "test_run_kernels passed" << std::endl;
+}
+
+/*
+ * Times each kernel of 'level' over rows of 4096 pixels of one color, a
+ * run as long as the row, and prints the pixels it gets through per
+ * nanosecond.
+ */
+template <typename Lane>
+void time_run_kernels(SimdLevel level)
+{
+	int const width = 4096;
+	int const repeats = 20000;
+
+	RunKernels<Lane> const kernels = run_kernels<Lane>(level);
+	std::vector<Lane> row(width, 1);
+
+	// The results feed into the next call, so that they are not dropped.
+	int sink = 0;
+
+	double ms_find_equal = time_ms([&]() {
+		for (int i = 0; i < repeats; i++)
+		{
+			sink += kernels.find_equal(row.data(), sink & 1, width, static_cast<Lane>(2));
+		}
+	});
+
+	double ms_find_not_equal = time_ms([&]() {
+		for (int i = 0; i < repeats; i++)
+		{
+			sink += kernels.find_not_equal(row.data(), sink & 1, width, static_cast<Lane>(1));
+		}
+	});
+
+	double ms_find_run_start = time_ms([&]() {
+		for (int i = 0; i < repeats; i++)
+		{
+			sink += kernels.find_run_start(row.data(), width - (sink & 1), static_cast<Lane>(1));
+		}
+	});
+
+	double ms_fill = time_ms([&]() {
+		for (int i = 0; i < repeats; i++)
+		{
+			kernels.fill(row.data(), sink & 1, width, static_cast<Lane>(1 + (sink & 1)));
+			sink += row[width - 1];
+		}
+	});
+
+	double num_pixels = static_cast<double>(width) * repeats;
+
+	std::cout << "\t" << std::setw(2) << 8 * sizeof(Lane) << "-bit " << std::setw(6) << simd_level_name(level)
+		<< " : find_equal " << std::setw(7) << num_pixels / (ms_find_equal * 1e6)
+		<< ", find_not_equal " << std::setw(7) << num_pixels / (ms_find_not_equal * 1e6)
+		<< ", find_run_start " << std::setw(7) << num_pixels / (ms_find_run_start * 1e6)
+		<< ", fill " << std::setw(7) << num_pixels / (ms_fill * 1e6)
+		<< " pixels/ns" << (sink == 42 ? " " : "") << std::endl;
+}
+
+void benchmark_run_kernels()
+{
+	SimdLevel const levels[] = { SimdLevel::scalar, SimdLevel::sse2, SimdLevel::avx2 };
+
+	std::cout << std::setprecision(2) << std::fixed;
+	std::cout << "benchmark_run_kernels (best for this CPU: " << simd_level_name(best_simd_level()) << ")" << std::endl;
+
+	for (SimdLevel level : levels)
+	{
+		if (level <= best_simd_level())
+		{
+			time_run_kernels<std::uint8_t>(level);
+			time_run_kernels<std::uint16_t>(level);
+			time_run_kernels<std::uint32_t>(level);
+		}
+	}
+}
+
+/*
+ * Fills random images through tiled raster files, with tiles of random
+ * sizes and as few as one resident tile, and compares them with
+ * 'flood_fill' on the same images in memory.
+ */
+template <typename Pixel>
+bool check_flood_fill_tiled(std::string const& path, unsigned seed)
+{
+	int const rows = 1 + seed % 37;
+	int const cols = 1 + (seed * 7) % 41;
+	int const tile_width = 1 + (seed / 3) % 9;
+	int const tile_height = 1 + (seed / 5) % 9;
+	std::size_t const max_resident_tiles = 1 + (seed / 7) % 4;
+
+	std::vector<std::vector<int> > image = make_random_image(rows, cols, 2 + seed % 2, seed);
+
+	if (!write_tiled_raster<Pixel>(path, cols, rows, tile_width, tile_height, [&image](int r, int c) { return image[r][c]; }))
+	{
+		return false;
+	}
+
+	TiledRaster<Pixel> raster;
+
+	if (!raster.open(path, max_resident_tiles))
+	{
+		return false;
+	}
+
+	int sr = static_cast<int>((seed * 13) % rows);
+	int sc = static_cast<int>((seed * 17) % cols);
+	int new_color = static_cast<int>(seed % 3);
+
+	TiledFillResult result = flood_fill_tiled<Pixel>(raster, sr, sc, static_cast<Pixel>(new_color));
+
+	std::vector<std::vector<int> > expected = image;
+	flood_fill(expected, sr, sc, new_color);
+
+	std::vector<std::vector<int> > actual;
+
+	std::size_t num_changed = 0;
+
+	for (int r = 0; r < rows; r++)
+	{
+		for (int c = 0; c < cols; c++)
+		{
+			num_changed += expected[r][c] != image[r][c];
+		}
+	}
+
+	return result.ok
+		&& raster.flush()
+		&& read_tiled_raster<Pixel>(path, actual)
+		&& actual == expected
+		&& result.fill.num_filled == num_changed
+		&& raster.stats().tile_loads - raster.stats().tile_evictions <= max_resident_tiles;
+}
+
+void test_flood_fill_tiled()
+{
+	std::string const path = "flood_fill_tiled_test.raster";
+
+	for (unsigned seed = 0; seed < 300; seed++)
+	{
+		if (!check_flood_fill_tiled<std::uint8_t>(path, seed) || !check_flood_fill_tiled<std::int32_t>(path, seed))
+		{
+			std::cout << "test_flood_fill_tiled failed for seed " << seed << std::endl;
+			std::remove(path.c_str());
+			return;
+		}
+	}
+
+	std::remove(path.c_str());
+
+	std::cout << "test_flood_fill_tiled passed" << std::endl;
+}
+
+/*
+ * Fills a corridor that winds through every fourth row of a 4096x4096
+ * raster, which crosses every tile of a row of tiles once per corridor.
+ * Once a row of tiles no longer fits in the cache, tiles are evicted
+ * and loaded again on every pass.
+ */
+void benchmark_flood_fill_tiled()
+{
+	int const size = 4096;
+	std::string const path = "flood_fill_tiled_benchmark.raster";
+
+	auto serpentine = [size](int r, int c) {
+		if (r % 4 != 3)
+		{
+			return 0;
+		}
+
+		// The walls leave a gap at alternating ends.
+		return (r / 4) % 2 == 0 ? int(c != size - 1) : int(c != 0);
+	};
+
+	struct Config
+	{
+		int tile_size;
+		std::size_t cache_bytes;
+	};
+
+	Config const configs[] = {
+		{ 64, 4 << 20 },
+		{ 256, 4 << 20 },
+		{ 1024, 4 << 20 },
+		{ 256, 512 << 10 },
+	};
+
+	std::cout << std::setprecision(3) << std::fixed;
+	std::cout << "benchmark_flood_fill_tiled (" << size << "x" << size << " uint8_t serpentine)" << std::endl;
+
+	for (Config const& config : configs)
+	{
+		if (!write_tiled_raster<std::uint8_t>(path, size, size, config.tile_size, config.tile_size, serpentine))
+		{
+			std::cout << "\tcould not write " << path << std::endl;
+			break;
+		}
+
+		std::size_t max_resident_tiles = config.cache_bytes / (static_cast<std::size_t>(config.tile_size) * config.tile_size);
+
+		TiledRaster<std::uint8_t> raster;
+		TiledFillResult result;
+
+		double ms = time_ms([&]() {
+			result.ok = raster.open(path, max_resident_tiles);
+
+			if (result.ok)
+			{
+				result = flood_fill_tiled<std::uint8_t>(raster, 0, 0, 2);
+				result.ok = result.ok && raster.flush();
+			}
+		});
+
+		TileCacheStats const& stats = raster.stats();
+
+		std::cout << "\ttiles " << std::setw(4) << config.tile_size << "x" << std::setw(4) << config.tile_size
+			<< ", " << std::setw(4) << max_resident_tiles << " resident : " << std::setw(9) << ms << " ms, "
+			<< stats.tile_loads << " loads, " << stats.tile_evictions << " evictions, "
+			<< stats.tile_writebacks << " writebacks, " << result.num_handoffs << " handoffs, "
+			<< result.fill.num_filled << " pixels" << (result.ok ? "" : " FAILED") << std::endl;
+	}
+
+	std::remove(path.c_str());
+}
+
+/*
+ * Whether every pixel that differs between 'before' and 'after' is in
+ * the box of 'changes'.
+ */
+bool changes_cover(std::vector<std::vector<int> > const& before, std::vector<std::vector<int> > const& after, FillResult const& changes)
+{
+	for (std::size_t r = 0; r < before.size(); r++)
+	{
+		for (std::size_t c = 0; c < before[r].size(); c++)
+		{
+			int row = static_cast<int>(r);
+			int col = static_cast<int>(c);
+
+			if (before[r][c] != after[r][c]
+				&& (row < changes.min_row || row > changes.max_row || col < changes.min_col || col > changes.max_col))
+			{
+				return false;
+			}
+		}
+	}
+
+	return true;
+}
+
+/*
+ * Runs random fills, undos and redos through a FillHistory, and checks
+ * the image after each against a stack of snapshots.
+ */
+bool check_fill_history(unsigned seed)
+{
+	int const rows = 1 + seed % 23;
+	int const cols = 1 + (seed * 7) % 29;
+
+	std::vector<std::vector<int> > image = make_random_image(rows, cols, 3, seed);
+	std::vector<std::vector<std::vector<int> > > snapshots(1, image);
+	std::size_t current = 0;
+
+	FillHistory<NestedImage> history(NestedImage { image });
+
+	for (int step = 0; step < 60; step++)
+	{
+		seed = seed * 1103515245 + 12345;
+
+		unsigned op = (seed >> 8) % 5;
+		FillResult changes;
+
+		if (op < 3)
+		{
+			int sr = static_cast<int>((seed >> 4) % rows);
+			int sc = static_cast<int>((seed >> 12) % cols);
+			int new_color = static_cast<int>((seed >> 20) % 3);
+
+			std::vector<std::vector<int> > expected = snapshots[current];
+			flood_fill(expected, sr, sc, new_color);
+
+			changes = history.fill(sr, sc, new_color);
+
+			if (changes.num_filled != 0)
+			{
+				snapshots.resize(++current);
+				snapshots.push_back(expected);
+			}
+		}
+		else if (op == 3)
+		{
+			if (history.undo(changes) != (current > 0))
+			{
+				return false;
+			}
+
+			current -= current > 0;
+		}
+		else
+		{
+			if (history.redo(changes) != (current + 1 < snapshots.size()))
+			{
+				return false;
+			}
+
+			current += current + 1 < snapshots.size();
+		}
+
+		if (image != snapshots[current]
+			|| history.num_undoable() != current
+			|| history.num_redoable() != snapshots.size() - 1 - current)
+		{
+			return false;
+		}
+
+		if (changes.num_filled != 0
+			&& !changes_cover(snapshots[op == 3 ? current + 1 : current - 1], snapshots[current], changes))
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+void test_fill_history()
+{
+	for (unsigned seed = 0; seed < 300; seed++)
+	{
+		if (!check_fill_history(seed))
+		{
+			std::cout << "test_fill_history failed for seed " << seed << std::endl;
+			return;
+		}
+	}
+
+	std::cout << "test_fill_history passed" << std::endl;
+}
+
+/*
+ * Times fills with and without the journal, then undo and redo, on an
+ * image in the caller's buffer, and compares the size of the journal
+ * with that of a snapshot of the image.
+ */
+void time_fill_history(std::string const& name, std::vector<std::vector<int> > const& nested)
+{
+	int const rows = static_cast<int>(nested.size());
+	int const cols = static_cast<int>(nested[0].size());
+
+	std::vector<std::uint32_t> buffer;
+
+	for (std::vector<int> const& row : nested)
+	{
+		buffer.insert(buffer.end(), row.begin(), row.end());
+	}
+
+	ImageView<std::uint32_t> view = { buffer.data(), cols, rows, cols };
+	std::uint32_t const old_color = buffer[0];
+	std::uint32_t const new_color = 7;
+
+	std::vector<Span> stack;
+
+	double ms_fill = time_ms([&]() { flood_fill_in_place(view, 0, 0, new_color, stack); });
+
+	flood_fill_in_place(view, 0, 0, old_color, stack);
+
+	FillHistory<ImageView<std::uint32_t> > history(view);
+	FillResult changes;
+
+	double ms_journaled = time_ms([&]() { changes = history.fill(0, 0, new_color); });
+	double ms_undo = time_ms([&]() { history.undo(changes); });
+	double ms_redo = time_ms([&]() { history.redo(changes); });
+
+	std::cout << "\t" << name << " : fill " << ms_fill << " ms, journaled " << ms_journaled
+		<< " ms, undo " << ms_undo << " ms, redo " << ms_redo << " ms, "
+		<< changes.num_filled << " pixels, journal " << history.journal_bytes() / 1024
+		<< " KiB against " << buffer.size() * sizeof(std::uint32_t) / 1024 << " KiB per snapshot" << std::endl;
+}
+
+void benchmark_fill_history()
+{
+	std::cout << std::setprecision(3) << std::fixed;
+	std::cout << "benchmark_fill_history" << std::endl;
+
+	time_fill_history("single color 4000x4000", std::vector<std::vector<int> >(4000, std::vector<int>(4000, 1)));
+	time_fill_history("spiral 4001x4001      ", make_spiral_image(4001));
+	time_fill_history("checkerboard 4000x4000", make_checkerboard_image(4000, 4000));
+}
+
+/*
+ * Compares 'flood_fill_parallel' with 'flood_fill_in_place' on a random
+ * image with padded rows, for random tile sizes and numbers of threads.
+ */
+template <typename Pixel>
+bool check_flood_fill_parallel(unsigned seed)
+{
+	int const rows = 1 + seed % 43;
+	int const cols = 1 + (seed * 7) % 47;
+	int const stride = cols + static_cast<int>(seed % 3);
+	int const tile_size = 1 + (seed / 3) % 11;
+	unsigned const num_threads = 1 + (seed / 5) % 5;
+
+	std::vector<std::vector<int> > nested = make_random_image(rows, cols, 2, seed);
+	std::vector<Pixel> expected_buffer(static_cast<std::size_t>(rows) * stride, Pixel(5));
+
+	for (int r = 0; r < rows; r++)
+	{
+		std::copy(nested[r].begin(), nested[r].end(), expected_buffer.begin() + static_cast<std::size_t>(r) * stride);
+	}
+
+	std::vector<Pixel> buffer = expected_buffer;
+
+	ImageView<Pixel> expected_view = { expected_buffer.data(), cols, rows, stride };
+	ImageView<Pixel> view = { buffer.data(), cols, rows, stride };
+
+	int sr = static_cast<int>((seed * 13) % rows);
+	int sc = static_cast<int>((seed * 17) % cols);
+	Pixel new_color = static_cast<Pixel>(seed % 3);
+
+	std::vector<Span> stack;
+
+	FillResult expected = flood_fill_in_place(expected_view, sr, sc, new_color, stack);
+	FillResult result = flood_fill_parallel(view, sr, sc, new_color, num_threads, tile_size);
+
+	return buffer == expected_buffer
+		&& result.num_filled == expected.num_filled
+		&& (result.num_filled == 0
+			|| (result.min_row == expected.min_row && result.max_row == expected.max_row
+				&& result.min_col == expected.min_col && result.max_col == expected.max_col));
+}
+
+void test_flood_fill_parallel()
+{
+	for (unsigned seed = 0; seed < 500; seed++)
+	{
+		if (!check_flood_fill_parallel<std::uint8_t>(seed) || !check_flood_fill_parallel<std::int32_t>(seed))
+		{
+			std::cout << "test_flood_fill_parallel failed for seed " << seed << std::endl;
+			return;
+		}
+	}
+
+	std::cout << "test_flood_fill_parallel passed" << std::endl;
+}
+
+/*
+ * Times the sequential and the parallel fills of the region of (0, 0)
+ * in a 'size' x 'size' image of bytes, made by pixel_at(r, c).
+ */
+template <typename PixelAt>
+void time_flood_fill_parallel(std::string const& name, int size, PixelAt pixel_at)
+{
+	std::vector<std::uint8_t> buffer(static_cast<std::size_t>(size) * size);
+
+	auto reset = [&]() {
+		for (int r = 0; r < size; r++)
+		{
+			for (int c = 0; c < size; c++)
+			{
+				buffer[static_cast<std::size_t>(r) * size + c] = static_cast<std::uint8_t>(pixel_at(r, c));
+			}
+		}
+	};
+
+	ImageView<std::uint8_t> view = { buffer.data(), size, size, size };
+	std::vector<Span> stack;
+	FillResult result;
+
+	reset();
+
+	double ms_sequential = time_ms([&]() { result = flood_fill_in_place(view, 0, 0, std::uint8_t(2), stack); });
+
+	std::cout << "\t" << name << " (" << result.num_filled << " pixels) : sequential " << ms_sequential << " ms";
+
+	unsigned const thread_counts[] = { 1, 2, 4 };
+
+	for (unsigned num_threads : thread_counts)
+	{
+		reset();
+
+		double ms = time_ms([&]() { result = flood_fill_parallel(view, 0, 0, std::uint8_t(2), num_threads); });
+
+		std::cout << ", " << num_threads << " threads " << ms << " ms";
+	}
+
+	std::cout << std::endl;
+}
+
+void benchmark_flood_fill_parallel()
+{
+	std::cout << std::setprecision(3) << std::fixed;
+	std::cout << "benchmark_flood_fill_parallel (uint8_t, 1024x1024 tiles, " << std::thread::hardware_concurrency() << " hardware threads)" << std::endl;
+
+	auto single_color = [](int, int) { return 0; };
+
+	auto serpentine = [](int size) {
+		return [size](int r, int c) {
+			if (r % 4 != 3)
+			{
+				return 0;
+			}
+
+			return (r / 4) % 2 == 0 ? int(c != size - 1) : int(c != 0);
+		};
+	};
+
+	// Walls every 64 pixels, with doors, so that the region is one room
+	// after another in every direction.
+	auto rooms = [](int r, int c) {
+		bool wall = (r % 64 == 63 && c % 64 != 31) || (c % 64 == 63 && r % 64 != 31);
+		return int(wall);
+	};
+
+	time_flood_fill_parallel("single color 4096x4096  ", 4096, single_color);
+	time_flood_fill_parallel("serpentine 4096x4096    ", 4096, serpentine(4096));
+	time_flood_fill_parallel("rooms 16384x16384       ", 16384, rooms);
+	time_flood_fill_parallel("single color 32768x32768", 32768, single_color);
 }
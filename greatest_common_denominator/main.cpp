@@ -1,15 +1,109 @@
 /*
  * @file     : main.cpp
  * @author   : antoinex
- * 
+ *
  * @question :
  *      Write a function to calculate the Greatest Common Denominator (GCD) of 2 numbers.
  */
 
 #include <iostream>
+#include <iomanip>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <random>
+#include <cstdint>
+#include <climits>
+#include <type_traits>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <fstream>
+#include <iterator>
+#include <cstdio>
+
+#include <unistd.h>
+
+#ifdef __SSE2__
+#include <immintrin.h>
+#endif
+
+/*
+ * The unsigned type of the same width as an integer type, which also holds
+ * the magnitude of its most negative value. std::make_unsigned does not
+ * know __int128 outside of the GNU dialects, hence the specializations.
+ */
+template <typename T>
+struct gcd_traits
+{
+    typedef typename std::make_unsigned<T>::type unsigned_type;
+};
+
+template <>
+struct gcd_traits<__int128>
+{
+    typedef unsigned __int128 unsigned_type;
+};
+
+template <>
+struct gcd_traits<unsigned __int128>
+{
+    typedef unsigned __int128 unsigned_type;
+};
+
+/*
+ * A multi-precision unsigned integer: 64-bit limbs, least significant
+ * first, with no leading zero limbs, so that 0 is the empty vector.
+ */
+typedef std::vector<std::uint64_t> Limbs;
+
+/*
+ * The result of 'batch_gcd': gcds[i] is the GCD of moduli[i] with the
+ * product of all the other moduli. 'ok' is false if a modulus is 0 or a
+ * checkpoint could not be written.
+ */
+struct BatchGcdResult
+{
+    bool ok;
+    std::vector<Limbs> gcds;
+    int levels_loaded;
+    int levels_computed;
+};
 
 int gcd(int x, int y);
 
+template <typename T>
+T euclid_gcd(T x, T y);
+
+template <typename T>
+constexpr typename gcd_traits<T>::unsigned_type binary_gcd(T x, T y);
+
+void binary_gcd_batch(std::uint32_t const* xs, std::uint32_t const* ys, std::uint32_t * gcds, std::size_t n);
+void binary_gcd_batch_scalar(std::uint32_t const* xs, std::uint32_t const* ys, std::uint32_t * gcds, std::size_t n);
+
+std::uint64_t gcd_reduce(std::uint64_t const* values, std::size_t n, unsigned num_threads = std::thread::hardware_concurrency());
+
+int compare_limbs(Limbs const& a, Limbs const& b);
+Limbs limbs_divide(Limbs const& u, Limbs const& v, Limbs * quotient);
+Limbs limbs_mod(Limbs const& u, Limbs const& v);
+Limbs multiply_limbs(Limbs const& a, Limbs const& b);
+Limbs euclid_gcd_limbs(Limbs a, Limbs b);
+Limbs lehmer_gcd(Limbs a, Limbs b);
+
+BatchGcdResult batch_gcd(std::vector<Limbs> const& moduli, unsigned num_threads = std::thread::hardware_concurrency(), std::string const& checkpoint_prefix = "");
+
+template <typename Function>
+double time_ms(Function function);
+
+void test_binary_gcd();
+void benchmark_binary_gcd();
+void test_binary_gcd_batch();
+void benchmark_binary_gcd_batch();
+void test_lehmer_gcd();
+void benchmark_lehmer_gcd();
+void test_batch_gcd();
+void benchmark_batch_gcd();
+
 int main()
 {
     std::cout << "gcd of 2 and 4 = " << gcd(2, 4) << std::endl;
@@ -17,6 +111,22 @@ int main()
     std::cout << "gcd of 6 and 9 = " << gcd(6, 9) << std::endl;
     std::cout << "gcd of 496 and 28 = " << gcd(496, 28) << std::endl;
 
+    test_binary_gcd();
+
+    benchmark_binary_gcd();
+
+    test_binary_gcd_batch();
+
+    benchmark_binary_gcd_batch();
+
+    test_lehmer_gcd();
+
+    benchmark_lehmer_gcd();
+
+    test_batch_gcd();
+
+    benchmark_batch_gcd();
+
     return 0;
 }
 
@@ -28,4 +138,2045 @@ int gcd(int x, int y)
     }
 
     return gcd(y % x, x);
+}
+
+/*
+ * 'gcd' for any unsigned type, as a loop.
+ */
+template <typename T>
+T euclid_gcd(T x, T y)
+{
+    while (x != 0)
+    {
+        T remainder = y % x;
+        y = x;
+        x = remainder;
+    }
+
+    return y;
+}
+
+constexpr int count_trailing_zeros(unsigned int x)
+{
+    return __builtin_ctz(x);
+}
+
+constexpr int count_trailing_zeros(unsigned long x)
+{
+    return __builtin_ctzl(x);
+}
+
+constexpr int count_trailing_zeros(unsigned long long x)
+{
+    return __builtin_ctzll(x);
+}
+
+/*
+ * There is no builtin for 128 bits, so count in the low half, or in the
+ * high half when the low half is 0.
+ */
+constexpr int count_trailing_zeros(unsigned __int128 x)
+{
+    return static_cast<std::uint64_t>(x) != 0
+        ? __builtin_ctzll(static_cast<std::uint64_t>(x))
+        : 64 + __builtin_ctzll(static_cast<std::uint64_t>(x >> 64));
+}
+
+/*
+ * |x| as the unsigned type of the same width, which holds it even for the
+ * most negative value of a signed type.
+ */
+template <typename T>
+constexpr typename gcd_traits<T>::unsigned_type magnitude(T x)
+{
+    typedef typename gcd_traits<T>::unsigned_type Unsigned;
+
+    return x < 0 ? Unsigned(0) - static_cast<Unsigned>(x) : static_cast<Unsigned>(x);
+}
+
+/*
+ * The GCD of two odd values. Written with selects rather than a swap, as
+ * the branch would be mispredicted about half the time.
+ */
+template <typename Word>
+constexpr Word odd_binary_gcd(Word a, Word b)
+{
+    while (a != b)
+    {
+        Word difference = a > b ? a - b : b - a;
+        b = a < b ? a : b;
+        a = difference >> count_trailing_zeros(difference);
+    }
+
+    return a;
+}
+
+/*
+ * The values only get smaller, so once both fit in 64 bits, the rest is
+ * done with the cheaper 64-bit steps.
+ */
+constexpr unsigned __int128 odd_binary_gcd(unsigned __int128 a, unsigned __int128 b)
+{
+    while ((a >> 64) != 0 || (b >> 64) != 0)
+    {
+        if (a == b)
+        {
+            return a;
+        }
+
+        unsigned __int128 difference = a > b ? a - b : b - a;
+        b = a < b ? a : b;
+        a = difference >> count_trailing_zeros(difference);
+    }
+
+    return odd_binary_gcd(static_cast<std::uint64_t>(a), static_cast<std::uint64_t>(b));
+}
+
+/*
+ * Binary (Stein's) GCD: only shifts, subtractions and comparisons, no
+ * division. The common factors of 2 are counted once up front, then each
+ * step replaces the larger of the two odd values by their difference,
+ * which is even, with all its factors of 2 shifted out at once.
+ *
+ * Signed inputs give the GCD of their magnitudes, as the unsigned type of
+ * the same width, so that e.g. binary_gcd(INT_MIN, 0) is representable.
+ * Types narrower than int are worked on as unsigned int.
+ */
+template <typename T>
+constexpr typename gcd_traits<T>::unsigned_type binary_gcd(T x, T y)
+{
+    typedef typename gcd_traits<T>::unsigned_type Unsigned;
+    typedef typename std::conditional<(sizeof(Unsigned) < sizeof(unsigned int)), unsigned int, Unsigned>::type Word;
+
+    Word a = magnitude(x);
+    Word b = magnitude(y);
+
+    if (a == 0)
+    {
+        return static_cast<Unsigned>(b);
+    }
+
+    if (b == 0)
+    {
+        return static_cast<Unsigned>(a);
+    }
+
+    int const shift = count_trailing_zeros(Word(a | b));
+
+    a >>= count_trailing_zeros(a);
+    b >>= count_trailing_zeros(b);
+
+    return static_cast<Unsigned>(odd_binary_gcd(a, b) << shift);
+}
+
+void binary_gcd_batch_scalar(std::uint32_t const* xs, std::uint32_t const* ys, std::uint32_t * gcds, std::size_t n)
+{
+    for (std::size_t i = 0; i < n; i++)
+    {
+        gcds[i] = binary_gcd(xs[i], ys[i]);
+    }
+}
+
+#ifdef __SSE2__
+
+/*
+ * The number of trailing zeros of each lane, from the exponent of the
+ * lowest set bit converted to float, which is exact for a power of 2.
+ * A lane of 2^31 converts to -2^31, which has the same exponent. Lanes
+ * of 0 give garbage, which callers blend away.
+ */
+__attribute__((target("avx2"))) inline __m256i count_trailing_zeros_avx2(__m256i x)
+{
+    __m256i lowest_bit = _mm256_and_si256(x, _mm256_sub_epi32(_mm256_setzero_si256(), x));
+    __m256i exponent = _mm256_srli_epi32(_mm256_castps_si256(_mm256_cvtepi32_ps(lowest_bit)), 23);
+
+    return _mm256_sub_epi32(_mm256_and_si256(exponent, _mm256_set1_epi32(0xFF)), _mm256_set1_epi32(127));
+}
+
+/*
+ * 'odd_binary_gcd' on 8 pairs at a time, one per lane. The lanes that are
+ * done, where a == b, are kept by blending, and the loop runs until all 8
+ * are done. Lanes with a 0 start done, with a = b = the other value.
+ */
+__attribute__((target("avx2"))) void binary_gcd_batch_avx2(std::uint32_t const* xs, std::uint32_t const* ys, std::uint32_t * gcds, std::size_t n)
+{
+    std::size_t i = 0;
+
+    for (; i + 8 <= n; i += 8)
+    {
+        __m256i a = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(xs + i));
+        __m256i b = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(ys + i));
+
+        __m256i const zero = _mm256_setzero_si256();
+        __m256i const either = _mm256_or_si256(a, b);
+        __m256i const has_zero = _mm256_or_si256(_mm256_cmpeq_epi32(a, zero), _mm256_cmpeq_epi32(b, zero));
+
+        __m256i const shift = _mm256_andnot_si256(has_zero, count_trailing_zeros_avx2(either));
+
+        a = _mm256_blendv_epi8(_mm256_srlv_epi32(a, count_trailing_zeros_avx2(a)), either, has_zero);
+        b = _mm256_blendv_epi8(_mm256_srlv_epi32(b, count_trailing_zeros_avx2(b)), either, has_zero);
+
+        __m256i done = _mm256_cmpeq_epi32(a, b);
+
+        while (_mm256_movemask_epi8(done) != -1)
+        {
+            __m256i smaller = _mm256_min_epu32(a, b);
+            __m256i difference = _mm256_sub_epi32(_mm256_max_epu32(a, b), smaller);
+
+            a = _mm256_blendv_epi8(_mm256_srlv_epi32(difference, count_trailing_zeros_avx2(difference)), a, done);
+            b = _mm256_blendv_epi8(smaller, b, done);
+
+            done = _mm256_cmpeq_epi32(a, b);
+        }
+
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(gcds + i), _mm256_sllv_epi32(a, shift));
+    }
+
+    binary_gcd_batch_scalar(xs + i, ys + i, gcds + i, n - i);
+}
+
+#endif
+
+/*
+ * gcds[i] = gcd(xs[i], ys[i]), with the AVX2 kernel when the CPU has it.
+ */
+void binary_gcd_batch(std::uint32_t const* xs, std::uint32_t const* ys, std::uint32_t * gcds, std::size_t n)
+{
+#ifdef __SSE2__
+    if (__builtin_cpu_supports("avx2"))
+    {
+        binary_gcd_batch_avx2(xs, ys, gcds, n);
+        return;
+    }
+#endif
+
+    binary_gcd_batch_scalar(xs, ys, gcds, n);
+}
+
+/*
+ * The GCD of a whole array. Each thread reduces its own slice, and the
+ * slices' GCDs are reduced at the end. As soon as any running value is 1,
+ * so is the answer: that thread raises 'found_one', and the others check
+ * it every block of values and stop.
+ *
+ * Once the running value is much smaller than the values, binary GCD
+ * would spend a subtraction per bit of the difference, so each value is
+ * first reduced modulo the running value, with one division.
+ */
+std::uint64_t gcd_reduce(std::uint64_t const* values, std::size_t n, unsigned num_threads)
+{
+    std::size_t const block_size = 4096;
+
+    num_threads = std::max(1u, std::min<unsigned>(num_threads, static_cast<unsigned>(n / block_size + 1)));
+
+    std::atomic<bool> found_one(false);
+    std::vector<std::uint64_t> partial_gcds(num_threads, 0);
+
+    auto reduce_slice = [&](unsigned thread) {
+        std::size_t begin = n * thread / num_threads;
+        std::size_t end = n * (thread + 1) / num_threads;
+
+        std::uint64_t running = 0;
+
+        for (std::size_t block = begin; block < end; block += block_size)
+        {
+            if (found_one.load(std::memory_order_relaxed))
+            {
+                break;
+            }
+
+            std::size_t block_end = std::min(end, block + block_size);
+
+            for (std::size_t i = block; i < block_end; i++)
+            {
+                running = (running == 0) ? values[i] : binary_gcd(running, values[i] % running);
+            }
+
+            if (running == 1)
+            {
+                found_one.store(true, std::memory_order_relaxed);
+                break;
+            }
+        }
+
+        partial_gcds[thread] = running;
+    };
+
+    std::vector<std::thread> threads;
+
+    for (unsigned thread = 1; thread < num_threads; thread++)
+    {
+        threads.emplace_back(reduce_slice, thread);
+    }
+
+    reduce_slice(0);
+
+    for (std::thread & thread : threads)
+    {
+        thread.join();
+    }
+
+    if (found_one.load())
+    {
+        return 1;
+    }
+
+    std::uint64_t result = 0;
+
+    for (std::uint64_t partial : partial_gcds)
+    {
+        result = binary_gcd(result, partial);
+    }
+
+    return result;
+}
+
+void trim_limbs(Limbs & a)
+{
+    while (!a.empty() && a.back() == 0)
+    {
+        a.pop_back();
+    }
+}
+
+int compare_limbs(Limbs const& a, Limbs const& b)
+{
+    if (a.size() != b.size())
+    {
+        return a.size() < b.size() ? -1 : 1;
+    }
+
+    for (std::size_t i = a.size(); i-- > 0;)
+    {
+        if (a[i] != b[i])
+        {
+            return a[i] < b[i] ? -1 : 1;
+        }
+    }
+
+    return 0;
+}
+
+Limbs to_limbs(unsigned __int128 x)
+{
+    Limbs a = { static_cast<std::uint64_t>(x), static_cast<std::uint64_t>(x >> 64) };
+    trim_limbs(a);
+    return a;
+}
+
+unsigned __int128 from_limbs(Limbs const& a)
+{
+    unsigned __int128 x = 0;
+
+    for (std::size_t i = a.size(); i-- > 0;)
+    {
+        x = x << 64 | a[i];
+    }
+
+    return x;
+}
+
+/*
+ * u mod v, v != 0, by Knuth's algorithm D (TAOCP 4.3.1), and u / v into
+ * 'quotient' if it is not null. v is shifted so that its top bit is set,
+ * and u by the same amount. Each quotient limb is then guessed from the
+ * top two limbs of the remainder and the top limb of v, corrected with the
+ * next limb of v, and is off by at most 1, which the add back fixes.
+ */
+Limbs limbs_divide(Limbs const& u, Limbs const& v, Limbs * quotient)
+{
+    if (compare_limbs(u, v) < 0)
+    {
+        if (quotient != nullptr)
+        {
+            quotient->clear();
+        }
+
+        return u;
+    }
+
+    std::size_t const n = v.size();
+
+    if (n == 1)
+    {
+        unsigned __int128 remainder = 0;
+
+        if (quotient != nullptr)
+        {
+            quotient->assign(u.size(), 0);
+        }
+
+        for (std::size_t i = u.size(); i-- > 0;)
+        {
+            remainder = remainder << 64 | u[i];
+
+            if (quotient != nullptr)
+            {
+                (*quotient)[i] = static_cast<std::uint64_t>(remainder / v[0]);
+            }
+
+            remainder %= v[0];
+        }
+
+        if (quotient != nullptr)
+        {
+            trim_limbs(*quotient);
+        }
+
+        return to_limbs(remainder);
+    }
+
+    std::size_t const m = u.size() - n;
+
+    if (quotient != nullptr)
+    {
+        quotient->assign(m + 1, 0);
+    }
+
+    int const shift = __builtin_clzll(v.back());
+
+    Limbs vn(n), un(u.size() + 1);
+
+    for (std::size_t i = n; i-- > 0;)
+    {
+        vn[i] = (v[i] << shift) | (shift != 0 && i > 0 ? v[i - 1] >> (64 - shift) : 0);
+    }
+
+    un[u.size()] = shift != 0 ? u.back() >> (64 - shift) : 0;
+
+    for (std::size_t i = u.size(); i-- > 0;)
+    {
+        un[i] = (u[i] << shift) | (shift != 0 && i > 0 ? u[i - 1] >> (64 - shift) : 0);
+    }
+
+    for (std::size_t j = m + 1; j-- > 0;)
+    {
+        unsigned __int128 const top = static_cast<unsigned __int128>(un[j + n]) << 64 | un[j + n - 1];
+        unsigned __int128 quotient_limb = top / vn[n - 1];
+        unsigned __int128 remainder = top % vn[n - 1];
+
+        while ((quotient_limb >> 64) != 0
+            || quotient_limb * vn[n - 2] > (remainder << 64 | un[j + n - 2]))
+        {
+            quotient_limb--;
+            remainder += vn[n - 1];
+
+            if ((remainder >> 64) != 0)
+            {
+                break;
+            }
+        }
+
+        // un[j .. j + n] -= quotient_limb * vn.
+        std::uint64_t carry = 0;
+        std::uint64_t borrow = 0;
+
+        for (std::size_t i = 0; i < n; i++)
+        {
+            unsigned __int128 product = quotient_limb * vn[i] + carry;
+            carry = static_cast<std::uint64_t>(product >> 64);
+
+            std::uint64_t low = static_cast<std::uint64_t>(product);
+            std::uint64_t difference = un[i + j] - low - borrow;
+            borrow = (un[i + j] < low) || (un[i + j] - low < borrow);
+            un[i + j] = difference;
+        }
+
+        bool const negative = un[j + n] < static_cast<unsigned __int128>(carry) + borrow;
+        un[j + n] -= carry + borrow;
+
+        if (quotient != nullptr)
+        {
+            (*quotient)[j] = static_cast<std::uint64_t>(quotient_limb) - negative;
+        }
+
+        if (negative)
+        {
+            std::uint64_t add_carry = 0;
+
+            for (std::size_t i = 0; i < n; i++)
+            {
+                unsigned __int128 sum = static_cast<unsigned __int128>(un[i + j]) + vn[i] + add_carry;
+                un[i + j] = static_cast<std::uint64_t>(sum);
+                add_carry = static_cast<std::uint64_t>(sum >> 64);
+            }
+
+            un[j + n] += add_carry;
+        }
+    }
+
+    Limbs remainder(n);
+
+    for (std::size_t i = 0; i < n; i++)
+    {
+        remainder[i] = (un[i] >> shift) | (shift != 0 ? un[i + 1] << (64 - shift) : 0);
+    }
+
+    trim_limbs(remainder);
+
+    if (quotient != nullptr)
+    {
+        trim_limbs(*quotient);
+    }
+
+    return remainder;
+}
+
+Limbs limbs_mod(Limbs const& u, Limbs const& v)
+{
+    return limbs_divide(u, v, nullptr);
+}
+
+/*
+ * 'euclid_gcd' on limbs: one full 'limbs_mod' per quotient.
+ */
+Limbs euclid_gcd_limbs(Limbs a, Limbs b)
+{
+    while (!b.empty())
+    {
+        Limbs remainder = limbs_mod(a, b);
+        a.swap(b);
+        b.swap(remainder);
+    }
+
+    return a;
+}
+
+/*
+ * The 62 bits of a starting at bit 'start', with the limbs past the end
+ * read as 0.
+ */
+std::int64_t leading_bits(Limbs const& a, std::size_t start)
+{
+    std::size_t const limb = start / 64;
+    int const offset = static_cast<int>(start % 64);
+
+    std::uint64_t low = limb < a.size() ? a[limb] : 0;
+    std::uint64_t high = limb + 1 < a.size() ? a[limb + 1] : 0;
+    std::uint64_t bits = offset == 0 ? low : (low >> offset) | (high << (64 - offset));
+
+    return static_cast<std::int64_t>(bits & (~std::uint64_t(0) >> 2));
+}
+
+/*
+ * out = x * a + y * b, where x and y are of opposite signs (or one is 0)
+ * and the result is known to be non-negative. Each limb's two products
+ * then partly cancel, so with the signed carry they fit in 128 bits.
+ */
+void linear_combination(Limbs & out, std::int64_t x, Limbs const& a, std::int64_t y, Limbs const& b)
+{
+    out.assign(a.size(), 0);
+
+    __int128 carry = 0;
+
+    for (std::size_t i = 0; i < a.size(); i++)
+    {
+        std::uint64_t const b_limb = i < b.size() ? b[i] : 0;
+
+        __int128 sum = static_cast<__int128>(x) * static_cast<__int128>(a[i])
+            + static_cast<__int128>(y) * static_cast<__int128>(b_limb)
+            + carry;
+
+        out[i] = static_cast<std::uint64_t>(sum);
+        carry = sum >> 64;
+    }
+
+    trim_limbs(out);
+}
+
+/*
+ * Lehmer's GCD (TAOCP 4.5.2, algorithm L). The leading 62 bits of a and b
+ * decide the first several quotients of Euclid on them, as long as those
+ * quotients are the same for both ends of the range the truncated values
+ * could stand for. Those steps are done on single words, building up the
+ * 2x2 matrix of cofactors, which is then applied to a and b in one pass,
+ * in place of one 'limbs_mod' per quotient. When not even one quotient is
+ * certain, one full division step is done instead.
+ *
+ * The leading bits are 62 rather than 63 so that they and the cofactors,
+ * which are no larger, can be added in int64 without overflow: x + A is
+ * 2^63 for 63 bits that are all ones, as in 2^p - 1.
+ *
+ * Once b fits in 2 limbs, the rest is one division and 'binary_gcd' on
+ * unsigned __int128.
+ */
+Limbs lehmer_gcd(Limbs a, Limbs b)
+{
+    trim_limbs(a);
+    trim_limbs(b);
+
+    if (compare_limbs(a, b) < 0)
+    {
+        a.swap(b);
+    }
+
+    Limbs next_a, next_b;
+
+    while (b.size() > 2)
+    {
+        std::size_t const bit_length = 64 * a.size() - __builtin_clzll(a.back());
+        std::size_t const start = bit_length - 62;
+
+        std::int64_t x = leading_bits(a, start);
+        std::int64_t y = leading_bits(b, start);
+        std::int64_t A = 1, B = 0, C = 0, D = 1;
+
+        while (y + C != 0 && y + D != 0)
+        {
+            std::int64_t const quotient = (x + A) / (y + C);
+
+            if (quotient != (x + B) / (y + D))
+            {
+                break;
+            }
+
+            std::int64_t t = A - quotient * C;
+            A = C;
+            C = t;
+            t = B - quotient * D;
+            B = D;
+            D = t;
+            t = x - quotient * y;
+            x = y;
+            y = t;
+        }
+
+        if (B == 0)
+        {
+            Limbs remainder = limbs_mod(a, b);
+            a.swap(b);
+            b.swap(remainder);
+        }
+        else
+        {
+            linear_combination(next_a, A, a, B, b);
+            linear_combination(next_b, C, a, D, b);
+            a.swap(next_a);
+            b.swap(next_b);
+        }
+    }
+
+    if (b.empty())
+    {
+        return a;
+    }
+
+    return to_limbs(binary_gcd(from_limbs(b), from_limbs(limbs_mod(a, b))));
+}
+
+Limbs add_limbs(Limbs const& a, Limbs const& b)
+{
+    Limbs sum(std::max(a.size(), b.size()) + 1, 0);
+    std::uint64_t carry = 0;
+
+    for (std::size_t i = 0; i + 1 < sum.size(); i++)
+    {
+        unsigned __int128 t = static_cast<unsigned __int128>(i < a.size() ? a[i] : 0) + (i < b.size() ? b[i] : 0) + carry;
+        sum[i] = static_cast<std::uint64_t>(t);
+        carry = static_cast<std::uint64_t>(t >> 64);
+    }
+
+    sum.back() = carry;
+    trim_limbs(sum);
+    return sum;
+}
+
+/*
+ * a - b, for a >= b.
+ */
+Limbs subtract_limbs(Limbs const& a, Limbs const& b)
+{
+    Limbs difference(a.size());
+    std::uint64_t borrow = 0;
+
+    for (std::size_t i = 0; i < a.size(); i++)
+    {
+        std::uint64_t const b_limb = i < b.size() ? b[i] : 0;
+
+        difference[i] = a[i] - b_limb - borrow;
+        borrow = (a[i] < b_limb) || (a[i] - b_limb < borrow);
+    }
+
+    trim_limbs(difference);
+    return difference;
+}
+
+/*
+ * a / β^k, where β = 2^64.
+ */
+Limbs shift_right_limbs(Limbs const& a, std::size_t k)
+{
+    return k < a.size() ? Limbs(a.begin() + k, a.end()) : Limbs();
+}
+
+Limbs schoolbook_multiply_limbs(Limbs const& a, Limbs const& b)
+{
+    Limbs product(a.size() + b.size(), 0);
+
+    for (std::size_t i = 0; i < a.size(); i++)
+    {
+        std::uint64_t carry = 0;
+
+        for (std::size_t j = 0; j < b.size(); j++)
+        {
+            unsigned __int128 t = static_cast<unsigned __int128>(a[i]) * b[j] + product[i + j] + carry;
+            product[i + j] = static_cast<std::uint64_t>(t);
+            carry = static_cast<std::uint64_t>(t >> 64);
+        }
+
+        product[i + b.size()] = carry;
+    }
+
+    trim_limbs(product);
+    return product;
+}
+
+/*
+ * Arithmetic modulo the prime p = 2^64 - 2^32 + 1, which has roots of
+ * unity of every order 2^k up to 2^32, and a cheap reduction: 2^64 is
+ * 2^32 - 1 and 2^96 is -1 modulo p. The wraps and borrows are taken
+ * back with masks rather than branches, as about half of them happen,
+ * at random.
+ */
+std::uint64_t const ntt_prime = 0xFFFFFFFF00000001ull;
+
+inline std::uint64_t ntt_reduce(unsigned __int128 x)
+{
+    std::uint64_t const low = static_cast<std::uint64_t>(x);
+    std::uint64_t const high = static_cast<std::uint64_t>(x >> 64);
+    std::uint64_t const high_high = high >> 32;
+    std::uint64_t const high_low = high & 0xFFFFFFFFu;
+
+    // Each wrap around 2^64 is worth 2^32 - 1.
+    std::uint64_t const t0 = low - high_high - (0xFFFFFFFFu & (std::uint64_t(0) - static_cast<std::uint64_t>(low < high_high)));
+    std::uint64_t const t1 = high_low * 0xFFFFFFFFu;
+    std::uint64_t t2 = t0 + t1;
+
+    t2 += 0xFFFFFFFFu & (std::uint64_t(0) - static_cast<std::uint64_t>(t2 < t1));
+
+    return t2 >= ntt_prime ? t2 - ntt_prime : t2;
+}
+
+inline std::uint64_t ntt_multiply(std::uint64_t a, std::uint64_t b)
+{
+    return ntt_reduce(static_cast<unsigned __int128>(a) * b);
+}
+
+inline std::uint64_t ntt_add(std::uint64_t a, std::uint64_t b)
+{
+    std::uint64_t const sum = a + b;
+    return sum - (ntt_prime & (std::uint64_t(0) - static_cast<std::uint64_t>((sum < a) | (sum >= ntt_prime))));
+}
+
+inline std::uint64_t ntt_subtract(std::uint64_t a, std::uint64_t b)
+{
+    return (a - b) + (ntt_prime & (std::uint64_t(0) - static_cast<std::uint64_t>(a < b)));
+}
+
+std::uint64_t ntt_power(std::uint64_t base, std::uint64_t exponent)
+{
+    std::uint64_t result = 1;
+
+    for (; exponent != 0; exponent >>= 1)
+    {
+        if (exponent & 1)
+        {
+            result = ntt_multiply(result, base);
+        }
+
+        base = ntt_multiply(base, base);
+    }
+
+    return result;
+}
+
+/*
+ * The number theoretic transform of a, whose size is a power of 2, in
+ * place, or its inverse. 7 generates the multiplicative group mod p.
+ */
+void ntt(std::vector<std::uint64_t> & a, bool inverse)
+{
+    std::size_t const n = a.size();
+
+    for (std::size_t i = 1, j = 0; i < n; i++)
+    {
+        std::size_t bit = n >> 1;
+
+        for (; j & bit; bit >>= 1)
+        {
+            j ^= bit;
+        }
+
+        j ^= bit;
+
+        if (i < j)
+        {
+            std::swap(a[i], a[j]);
+        }
+    }
+
+    std::vector<std::uint64_t> roots;
+
+    for (std::size_t length = 2; length <= n; length <<= 1)
+    {
+        std::uint64_t root = ntt_power(7, (ntt_prime - 1) / length);
+
+        if (inverse)
+        {
+            root = ntt_power(root, ntt_prime - 2);
+        }
+
+        std::size_t const half = length / 2;
+
+        roots.resize(half);
+        roots[0] = 1;
+
+        for (std::size_t k = 1; k < half; k++)
+        {
+            roots[k] = ntt_multiply(roots[k - 1], root);
+        }
+
+        for (std::size_t i = 0; i < n; i += length)
+        {
+            for (std::size_t k = 0; k < half; k++)
+            {
+                std::uint64_t const even = a[i + k];
+                std::uint64_t const odd = ntt_multiply(a[i + k + half], roots[k]);
+
+                a[i + k] = ntt_add(even, odd);
+                a[i + k + half] = ntt_subtract(even, odd);
+            }
+        }
+    }
+
+    if (inverse)
+    {
+        std::uint64_t const inverse_n = ntt_power(n % ntt_prime, ntt_prime - 2);
+
+        for (std::uint64_t & x : a)
+        {
+            x = ntt_multiply(x, inverse_n);
+        }
+    }
+}
+
+/*
+ * a * b. Past several hundred limbs, by one NTT convolution mod p of the
+ * 16-bit digits of a and b: each coefficient of the product of the digit
+ * polynomials is less than 2^32 times the number of digits, so below p,
+ * and is exact. A square is transformed once.
+ */
+Limbs multiply_limbs(Limbs const& a, Limbs const& b)
+{
+    std::size_t const ntt_threshold = 768;
+
+    if (a.empty() || b.empty())
+    {
+        return Limbs();
+    }
+
+    if (std::min(a.size(), b.size()) < ntt_threshold)
+    {
+        return schoolbook_multiply_limbs(a, b);
+    }
+
+    std::size_t const num_digits = 4 * (a.size() + b.size());
+    std::size_t size = 1;
+
+    while (size < num_digits)
+    {
+        size <<= 1;
+    }
+
+    auto transform = [&](Limbs const& x) {
+        std::vector<std::uint64_t> digits(size, 0);
+
+        for (std::size_t i = 0; i < x.size(); i++)
+        {
+            for (int k = 0; k < 4; k++)
+            {
+                digits[4 * i + k] = (x[i] >> (16 * k)) & 0xFFFFu;
+            }
+        }
+
+        ntt(digits, false);
+        return digits;
+    };
+
+    std::vector<std::uint64_t> product_digits = transform(a);
+
+    if (&a == &b)
+    {
+        for (std::uint64_t & x : product_digits)
+        {
+            x = ntt_multiply(x, x);
+        }
+    }
+    else
+    {
+        std::vector<std::uint64_t> const b_digits = transform(b);
+
+        for (std::size_t i = 0; i < size; i++)
+        {
+            product_digits[i] = ntt_multiply(product_digits[i], b_digits[i]);
+        }
+    }
+
+    ntt(product_digits, true);
+
+    Limbs product(a.size() + b.size(), 0);
+    unsigned __int128 carry = 0;
+
+    for (std::size_t i = 0; i < num_digits; i++)
+    {
+        carry += product_digits[i];
+        product[i / 4] |= static_cast<std::uint64_t>(carry & 0xFFFFu) << (16 * (i % 4));
+        carry >>= 16;
+    }
+
+    trim_limbs(product);
+    return product;
+}
+
+/*
+ * About β^2n / d, where d has n limbs, to within a few units. Small d are
+ * divided exactly. Otherwise the top h = n / 2 + 2 limbs of d give y, about
+ * β^2h / d_top, and so x = y β^(n - h), the first half of the limbs of the
+ * reciprocal. One Newton step, x + x (β^2n - d x) / β^2n, doubles them.
+ * The step is done on y rather than x, whose low limbs are 0, and with
+ * only the top limbs of the error term that reach the units of the result.
+ */
+Limbs reciprocal_limbs(Limbs const& d)
+{
+    std::size_t const n = d.size();
+
+    if (n <= 16)
+    {
+        Limbs power(2 * n + 1, 0);
+        power.back() = 1;
+
+        Limbs quotient;
+        limbs_divide(power, d, &quotient);
+        return quotient;
+    }
+
+    std::size_t const h = n / 2 + 2;
+
+    Limbs const y = reciprocal_limbs(Limbs(d.end() - h, d.end()));
+
+    // β^2n - d x = (β^(n + h) - d y) β^(n - h), and the step adds
+    // y (β^(n + h) - d y) / β^2h to y, at the scale of x.
+    Limbs power(n + h + 1, 0);
+    power.back() = 1;
+
+    Limbs const dy = multiply_limbs(d, y);
+    bool const below = compare_limbs(dy, power) <= 0;
+
+    Limbs const error = shift_right_limbs(below ? subtract_limbs(power, dy) : subtract_limbs(dy, power), h - 2);
+    Limbs const step = shift_right_limbs(multiply_limbs(y, error), h + 2);
+
+    Limbs x(n - h, 0);
+    x.insert(x.end(), y.begin(), y.end());
+
+    return below ? add_limbs(x, step) : subtract_limbs(x, add_limbs(step, Limbs { 1 }));
+}
+
+/*
+ * u mod d, given r = 'reciprocal_limbs(d)', with multiplications only:
+ * the quotient of 2n limbs of u by d is about u r / β^2n, and its few
+ * units of error are corrected by comparing with u. Longer u are reduced
+ * 2n limbs at a time from the top. Should the estimate ever be far off,
+ * this falls back to 'limbs_mod'.
+ */
+Limbs limbs_mod_by_reciprocal(Limbs u, Limbs const& d, Limbs const& r)
+{
+    std::size_t const n = d.size();
+
+    while (u.size() > 2 * n)
+    {
+        std::size_t const k = u.size() - 2 * n;
+
+        Limbs top = limbs_mod_by_reciprocal(Limbs(u.begin() + k, u.end()), d, r);
+
+        u.resize(k);
+        u.insert(u.end(), top.begin(), top.end());
+        trim_limbs(u);
+    }
+
+    Limbs const quotient = shift_right_limbs(multiply_limbs(u, r), 2 * n);
+    Limbs product = multiply_limbs(quotient, d);
+
+    for (int corrections = 0; compare_limbs(product, u) > 0; corrections++)
+    {
+        if (corrections == 8)
+        {
+            return limbs_mod(u, d);
+        }
+
+        product = subtract_limbs(product, d);
+    }
+
+    Limbs remainder = subtract_limbs(u, product);
+
+    for (int corrections = 0; compare_limbs(remainder, d) >= 0; corrections++)
+    {
+        if (corrections == 8)
+        {
+            return limbs_mod(remainder, d);
+        }
+
+        remainder = subtract_limbs(remainder, d);
+    }
+
+    return remainder;
+}
+
+template <typename Function>
+void run_in_parallel(unsigned num_threads, Function function)
+{
+    std::vector<std::thread> threads;
+
+    for (unsigned i = 1; i < num_threads; i++)
+    {
+        threads.emplace_back(function, i);
+    }
+
+    function(0u);
+
+    for (std::thread & thread : threads)
+    {
+        thread.join();
+    }
+}
+
+/*
+ * Calls function(i) for each i < n, with the indices handed out one at a
+ * time, as the nodes of a level can differ in size.
+ */
+template <typename Function>
+void parallel_for(std::size_t n, unsigned num_threads, Function function)
+{
+    std::atomic<std::size_t> next(0);
+
+    run_in_parallel(std::max(1u, std::min<unsigned>(num_threads, static_cast<unsigned>(std::min<std::size_t>(n, UINT_MAX)))), [&](unsigned) {
+        for (std::size_t i = next++; i < n; i = next++)
+        {
+            function(i);
+        }
+    });
+}
+
+/*
+ * FNV-1a over the moduli, so that a checkpoint from another batch is not
+ * taken for one of this batch.
+ */
+std::uint64_t batch_gcd_fingerprint(std::vector<Limbs> const& moduli)
+{
+    std::uint64_t hash = 0xCBF29CE484222325ull;
+
+    auto mix = [&](std::uint64_t word) {
+        for (int i = 0; i < 8; i++)
+        {
+            hash = (hash ^ ((word >> (8 * i)) & 0xFF)) * 0x100000001B3ull;
+        }
+    };
+
+    mix(moduli.size());
+
+    for (Limbs const& modulus : moduli)
+    {
+        mix(modulus.size());
+
+        for (std::uint64_t limb : modulus)
+        {
+            mix(limb);
+        }
+    }
+
+    return hash;
+}
+
+/*
+ * A checkpoint holds one level of one tree: "BGCD", the tree (0 for the
+ * product tree, 1 for the remainder tree), the level, the fingerprint of
+ * the moduli and the number of values, each as 64 bits, then each value
+ * as its number of limbs followed by its limbs. It is written to a
+ * temporary file, synced to disk, and only then renamed over the
+ * checkpoint, so that after a crash the path holds either the whole new
+ * checkpoint or what it held before. The rename itself may be lost, as
+ * the directory is not synced, which leaves the older state.
+ */
+bool write_batch_gcd_checkpoint(std::string const& path, std::uint64_t tree, std::uint64_t level, std::uint64_t fingerprint, std::vector<Limbs> const& values)
+{
+    std::string const temporary_path = path + ".tmp";
+
+    std::FILE * out = std::fopen(temporary_path.c_str(), "wb");
+
+    if (out == nullptr)
+    {
+        return false;
+    }
+
+    std::uint64_t const header[] = { tree, level, fingerprint, values.size() };
+
+    bool ok = std::fwrite("BGCD", 1, 4, out) == 4
+        && std::fwrite(header, sizeof(header), 1, out) == 1;
+
+    for (std::size_t i = 0; ok && i < values.size(); i++)
+    {
+        std::uint64_t const size = values[i].size();
+
+        ok = std::fwrite(&size, sizeof(size), 1, out) == 1
+            && (size == 0 || std::fwrite(values[i].data(), sizeof(std::uint64_t), size, out) == size);
+    }
+
+    ok = ok && std::fflush(out) == 0 && fsync(fileno(out)) == 0;
+    ok = (std::fclose(out) == 0) && ok;
+
+    return ok && std::rename(temporary_path.c_str(), path.c_str()) == 0;
+}
+
+/*
+ * Reads a checkpoint back, if there is one at 'path' for this tree, level
+ * and batch, with the expected number of values, all well formed. 'values'
+ * is only replaced once the whole checkpoint has been read.
+ */
+bool read_batch_gcd_checkpoint(std::string const& path, std::uint64_t tree, std::uint64_t level, std::uint64_t fingerprint, std::size_t num_values, std::vector<Limbs> & values)
+{
+    std::ifstream in(path, std::ios::binary);
+
+    char magic[4];
+    std::uint64_t header[4];
+
+    if (!in.read(magic, 4) || !in.read(reinterpret_cast<char *>(header), sizeof(header))
+        || std::string(magic, 4) != "BGCD"
+        || header[0] != tree || header[1] != level || header[2] != fingerprint || header[3] != num_values)
+    {
+        return false;
+    }
+
+    std::vector<Limbs> read_values(num_values);
+
+    for (Limbs & value : read_values)
+    {
+        std::uint64_t size = 0;
+
+        if (!in.read(reinterpret_cast<char *>(&size), sizeof(size)) || size > (std::uint64_t(1) << 40))
+        {
+            return false;
+        }
+
+        value.resize(size);
+
+        if (!in.read(reinterpret_cast<char *>(value.data()), static_cast<std::streamsize>(size * sizeof(std::uint64_t)))
+            || (size != 0 && value.back() == 0))
+        {
+            return false;
+        }
+    }
+
+    values.swap(read_values);
+    return true;
+}
+
+/*
+ * Bernstein's batch GCD. The product tree multiplies the moduli in pairs,
+ * level by level, up to their product P. The remainder tree then goes back
+ * down, reducing P modulo the square of each node, from the remainder at
+ * its parent: at the leaves, that leaves P mod N^2 for each modulus N, and
+ * gcd(N, P / N) is gcd(N, (P mod N^2) / N).
+ *
+ * The nodes of each level are spread over the threads. Each level is
+ * checkpointed under 'checkpoint_prefix', if not empty, and a later call
+ * on the same moduli starts from the checkpoints it finds: the levels of
+ * the product tree it has, and the lowest level of the remainder tree.
+ * The checkpoints are left in place.
+ */
+BatchGcdResult batch_gcd(std::vector<Limbs> const& moduli, unsigned num_threads, std::string const& checkpoint_prefix)
+{
+    BatchGcdResult result = { true, std::vector<Limbs>(), 0, 0 };
+
+    for (Limbs const& modulus : moduli)
+    {
+        if (modulus.empty() || modulus.back() == 0)
+        {
+            result.ok = false;
+            return result;
+        }
+    }
+
+    if (moduli.empty())
+    {
+        return result;
+    }
+
+    bool const checkpointing = !checkpoint_prefix.empty();
+    std::uint64_t const fingerprint = checkpointing ? batch_gcd_fingerprint(moduli) : 0;
+
+    auto checkpoint_path = [&](std::uint64_t tree, std::size_t level) {
+        return checkpoint_prefix + (tree == 0 ? "product_" : "remainder_") + std::to_string(level);
+    };
+
+    std::vector<std::vector<Limbs> > products(1, moduli);
+
+    while (products.back().size() > 1)
+    {
+        std::vector<Limbs> const& below = products.back();
+        std::vector<Limbs> level((below.size() + 1) / 2);
+        std::size_t const index = products.size();
+
+        if (checkpointing && read_batch_gcd_checkpoint(checkpoint_path(0, index), 0, index, fingerprint, level.size(), level))
+        {
+            result.levels_loaded++;
+        }
+        else
+        {
+            parallel_for(level.size(), num_threads, [&](std::size_t i) {
+                level[i] = 2 * i + 1 < below.size() ? multiply_limbs(below[2 * i], below[2 * i + 1]) : below[2 * i];
+            });
+
+            result.levels_computed++;
+
+            if (checkpointing && !write_batch_gcd_checkpoint(checkpoint_path(0, index), 0, index, fingerprint, level))
+            {
+                result.ok = false;
+                return result;
+            }
+        }
+
+        products.push_back(std::move(level));
+    }
+
+    // The remainder at the root, P mod P^2, is P itself.
+    std::size_t level = products.size() - 1;
+    std::vector<Limbs> remainders = products.back();
+
+    if (checkpointing)
+    {
+        for (std::size_t lowest = 0; lowest < level; lowest++)
+        {
+            if (read_batch_gcd_checkpoint(checkpoint_path(1, lowest), 1, lowest, fingerprint, products[lowest].size(), remainders))
+            {
+                result.levels_loaded++;
+                level = lowest;
+                break;
+            }
+        }
+    }
+
+    for (; level > 0; level--)
+    {
+        std::vector<Limbs> const& nodes = products[level - 1];
+        std::vector<Limbs> below(nodes.size());
+
+        parallel_for(nodes.size(), num_threads, [&](std::size_t i) {
+            Limbs const square = multiply_limbs(nodes[i], nodes[i]);
+            below[i] = limbs_mod_by_reciprocal(remainders[i / 2], square, reciprocal_limbs(square));
+        });
+
+        remainders.swap(below);
+        result.levels_computed++;
+
+        if (checkpointing && !write_batch_gcd_checkpoint(checkpoint_path(1, level - 1), 1, level - 1, fingerprint, remainders))
+        {
+            result.ok = false;
+            return result;
+        }
+    }
+
+    result.gcds.resize(moduli.size());
+
+    parallel_for(moduli.size(), num_threads, [&](std::size_t i) {
+        Limbs quotient;
+        limbs_divide(remainders[i], moduli[i], &quotient);
+        result.gcds[i] = lehmer_gcd(quotient, moduli[i]);
+    });
+
+    return result;
+}
+
+static_assert(binary_gcd(0u, 0u) == 0u, "gcd(0, 0)");
+static_assert(binary_gcd(0u, 7u) == 7u, "gcd(0, y)");
+static_assert(binary_gcd(496u, 28u) == 4u, "gcd(496, 28)");
+static_assert(binary_gcd(-12, 18) == 6u, "negative input");
+static_assert(binary_gcd(INT_MIN, 0) == 2147483648u, "INT_MIN");
+static_assert(binary_gcd(INT64_MIN, INT64_MIN) == std::uint64_t(1) << 63, "INT64_MIN");
+static_assert(binary_gcd(std::uint64_t(1) << 40, std::uint64_t(3) << 20) == std::uint64_t(1) << 20, "shared factors of 2");
+static_assert(binary_gcd(static_cast<unsigned __int128>(3) << 100, static_cast<unsigned __int128>(9) << 70) == static_cast<unsigned __int128>(3) << 70, "128 bits");
+
+/*
+ * Compares 'binary_gcd' with 'euclid_gcd' on random values of every width,
+ * with shared factors of 2 and negative signed values.
+ */
+void test_binary_gcd()
+{
+    std::mt19937_64 generator(23);
+
+    for (int i = 0; i < 200000; i++)
+    {
+        std::uint64_t shared = generator() % 1000 + 1;
+        int shift_x = static_cast<int>(generator() % 20);
+        int shift_y = static_cast<int>(generator() % 20);
+
+        std::uint64_t x = ((generator() >> (generator() % 64)) | 1) * shared << shift_x;
+        std::uint64_t y = ((generator() >> (generator() % 64)) | 1) * shared << shift_y;
+
+        if (generator() % 16 == 0)
+        {
+            x = 0;
+        }
+
+        std::uint32_t x_32 = static_cast<std::uint32_t>(x);
+        std::uint32_t y_32 = static_cast<std::uint32_t>(y);
+
+        unsigned __int128 x_128 = (static_cast<unsigned __int128>(x) << 64) | y;
+        unsigned __int128 y_128 = static_cast<unsigned __int128>(y) << (generator() % 64);
+
+        std::int64_t signed_x = -static_cast<std::int64_t>(x >> 1);
+        std::int32_t signed_y = static_cast<std::int32_t>(y_32 >> 1);
+
+        if (binary_gcd(x, y) != euclid_gcd(x, y)
+            || binary_gcd(x_32, y_32) != euclid_gcd(x_32, y_32)
+            || binary_gcd(x_128, y_128) != euclid_gcd(x_128, y_128)
+            || binary_gcd(signed_x, static_cast<std::int64_t>(y >> 1)) != euclid_gcd(x >> 1, y >> 1)
+            || binary_gcd(-signed_y, signed_y) != euclid_gcd(y_32 >> 1, y_32 >> 1)
+            || binary_gcd(static_cast<std::uint16_t>(x), static_cast<std::uint16_t>(y)) != euclid_gcd<unsigned>(std::uint16_t(x), std::uint16_t(y)))
+        {
+            std::cout << "test_binary_gcd failed for " << x << ", " << y << std::endl;
+            return;
+        }
+    }
+
+    std::cout << "test_binary_gcd passed" << std::endl;
+}
+
+/*
+ * Times 'euclid_gcd' and 'binary_gcd' over the same pairs, and prints the
+ * nanoseconds per GCD of each.
+ */
+template <typename T>
+void time_gcd(std::string const& name, std::vector<T> const& xs, std::vector<T> const& ys)
+{
+    T sink = 0;
+
+    double ms_euclid = time_ms([&]() {
+        for (std::size_t i = 0; i < xs.size(); i++)
+        {
+            sink += euclid_gcd(xs[i], ys[i]);
+        }
+    });
+
+    double ms_binary = time_ms([&]() {
+        for (std::size_t i = 0; i < xs.size(); i++)
+        {
+            sink += binary_gcd(xs[i], ys[i]);
+        }
+    });
+
+    double num_pairs = static_cast<double>(xs.size());
+
+    std::cout << "\t" << name << " : euclid " << std::setw(7) << ms_euclid * 1e6 / num_pairs
+        << " ns, binary " << std::setw(7) << ms_binary * 1e6 / num_pairs << " ns"
+        << (sink == 42 ? " " : "") << std::endl;
+}
+
+void benchmark_binary_gcd()
+{
+    std::size_t const num_pairs = 1000000;
+
+    std::mt19937_64 generator(29);
+
+    std::vector<std::uint32_t> small_x, small_y, uniform_32_x, uniform_32_y;
+    std::vector<std::uint64_t> uniform_64_x, uniform_64_y, fibonacci_x, fibonacci_y, powers_x, powers_y;
+    std::vector<unsigned __int128> uniform_128_x, uniform_128_y;
+
+    std::vector<std::uint64_t> fibonacci = { 1, 2 };
+
+    while (fibonacci.size() < 92)
+    {
+        fibonacci.push_back(fibonacci[fibonacci.size() - 1] + fibonacci[fibonacci.size() - 2]);
+    }
+
+    for (std::size_t i = 0; i < num_pairs; i++)
+    {
+        small_x.push_back(static_cast<std::uint32_t>(generator() % 1000 + 1));
+        small_y.push_back(static_cast<std::uint32_t>(generator() % 1000 + 1));
+
+        uniform_32_x.push_back(static_cast<std::uint32_t>(generator()));
+        uniform_32_y.push_back(static_cast<std::uint32_t>(generator()));
+
+        uniform_64_x.push_back(generator());
+        uniform_64_y.push_back(generator());
+
+        // Consecutive Fibonacci numbers take Euclid the most steps.
+        std::size_t k = 60 + generator() % 30;
+        fibonacci_x.push_back(fibonacci[k]);
+        fibonacci_y.push_back(fibonacci[k + 1]);
+
+        // Odd values times large powers of 2, which binary GCD shifts out.
+        powers_x.push_back((generator() >> 40 | 1) << (generator() % 40));
+        powers_y.push_back((generator() >> 40 | 1) << (generator() % 40));
+
+        uniform_128_x.push_back(static_cast<unsigned __int128>(generator()) << 64 | generator());
+        uniform_128_y.push_back(static_cast<unsigned __int128>(generator()) << 64 | generator());
+    }
+
+    std::cout << std::setprecision(1) << std::fixed;
+    std::cout << "benchmark_binary_gcd (" << num_pairs << " pairs each)" << std::endl;
+
+    time_gcd("small (<= 1000), 32-bit   ", small_x, small_y);
+    time_gcd("uniform 32-bit            ", uniform_32_x, uniform_32_y);
+    time_gcd("uniform 64-bit            ", uniform_64_x, uniform_64_y);
+    time_gcd("fibonacci pairs, 64-bit   ", fibonacci_x, fibonacci_y);
+    time_gcd("odd * 2^k, 64-bit         ", powers_x, powers_y);
+    time_gcd("uniform 128-bit           ", uniform_128_x, uniform_128_y);
+}
+
+/*
+ * Compares 'binary_gcd_batch' and 'gcd_reduce' with 'binary_gcd', with
+ * zeros, batch sizes that are not multiples of 8, and reductions that do
+ * and do not reach 1.
+ */
+void test_binary_gcd_batch()
+{
+    std::mt19937_64 generator(31);
+
+    for (std::size_t n = 0; n < 200; n++)
+    {
+        std::vector<std::uint32_t> xs(n), ys(n), gcds(n, 7);
+
+        for (std::size_t i = 0; i < n; i++)
+        {
+            std::uint32_t shared = static_cast<std::uint32_t>(generator() % 100 + 1) << (generator() % 8);
+
+            xs[i] = generator() % 7 == 0 ? 0 : static_cast<std::uint32_t>(generator() >> (32 + generator() % 32)) * shared;
+            ys[i] = generator() % 7 == 0 ? 0 : static_cast<std::uint32_t>(generator() >> (32 + generator() % 32)) * shared;
+        }
+
+        if (n == 10)
+        {
+            xs[3] = 0x80000000u;
+            ys[3] = 0x80000000u;
+            xs[4] = 0xFFFFFFFFu;
+            ys[4] = 0xFFFFFFFEu;
+        }
+
+        binary_gcd_batch(xs.data(), ys.data(), gcds.data(), n);
+
+        for (std::size_t i = 0; i < n; i++)
+        {
+            if (gcds[i] != binary_gcd(xs[i], ys[i]))
+            {
+                std::cout << "test_binary_gcd_batch failed for " << xs[i] << ", " << ys[i] << std::endl;
+                return;
+            }
+        }
+    }
+
+    for (int round = 0; round < 40; round++)
+    {
+        std::size_t n = generator() % 100000;
+        std::uint64_t factor = generator() % 1000 + 1;
+
+        std::vector<std::uint64_t> values(n);
+
+        for (std::uint64_t & value : values)
+        {
+            value = (generator() >> 24) * factor;
+        }
+
+        // Some rounds have a 1 late in the array, which the reduction must
+        // still find.
+        if (round % 3 == 0 && n > 0)
+        {
+            values[n - 1 - n / 10] = factor + 1;
+        }
+
+        std::uint64_t expected = 0;
+
+        for (std::uint64_t value : values)
+        {
+            expected = binary_gcd(expected, value);
+        }
+
+        for (unsigned num_threads = 1; num_threads <= 4; num_threads++)
+        {
+            if (gcd_reduce(values.data(), n, num_threads) != expected)
+            {
+                std::cout << "test_binary_gcd_batch failed for a reduction of " << n << " values with " << num_threads << " threads" << std::endl;
+                return;
+            }
+        }
+    }
+
+    std::cout << "test_binary_gcd_batch passed" << std::endl;
+}
+
+void benchmark_binary_gcd_batch()
+{
+    std::size_t const num_pairs = 4000000;
+
+    std::mt19937_64 generator(37);
+
+    std::vector<std::uint32_t> xs(num_pairs), ys(num_pairs), small_xs(num_pairs), small_ys(num_pairs), gcds(num_pairs);
+
+    for (std::size_t i = 0; i < num_pairs; i++)
+    {
+        xs[i] = static_cast<std::uint32_t>(generator());
+        ys[i] = static_cast<std::uint32_t>(generator());
+        small_xs[i] = static_cast<std::uint32_t>(generator() % 1000 + 1);
+        small_ys[i] = static_cast<std::uint32_t>(generator() % 1000 + 1);
+    }
+
+    std::cout << std::setprecision(1) << std::fixed;
+    std::cout << "benchmark_binary_gcd_batch (" << num_pairs << " pairs, " << std::thread::hardware_concurrency() << " hardware threads)" << std::endl;
+
+    auto per_second = [](std::size_t n, double ms) {
+        return static_cast<double>(n) / ms / 1e3;
+    };
+
+    std::uint32_t sink = 0;
+
+    double ms_euclid = time_ms([&]() {
+        for (std::size_t i = 0; i < num_pairs; i++)
+        {
+            sink += euclid_gcd(xs[i], ys[i]);
+        }
+    });
+
+    double ms_scalar = time_ms([&]() { binary_gcd_batch_scalar(xs.data(), ys.data(), gcds.data(), num_pairs); });
+    double ms_batch = time_ms([&]() { binary_gcd_batch(xs.data(), ys.data(), gcds.data(), num_pairs); });
+    double ms_small_scalar = time_ms([&]() { binary_gcd_batch_scalar(small_xs.data(), small_ys.data(), gcds.data(), num_pairs); });
+    double ms_small_batch = time_ms([&]() { binary_gcd_batch(small_xs.data(), small_ys.data(), gcds.data(), num_pairs); });
+
+    std::cout << "\tpairs, uniform 32-bit : euclid " << per_second(num_pairs, ms_euclid)
+        << " M/s, binary " << per_second(num_pairs, ms_scalar)
+        << " M/s, batch " << per_second(num_pairs, ms_batch) << " M/s" << (sink == 42 ? " " : "") << std::endl;
+    std::cout << "\tpairs, <= 1000        : binary " << per_second(num_pairs, ms_small_scalar)
+        << " M/s, batch " << per_second(num_pairs, ms_small_batch) << " M/s" << std::endl;
+
+    // Multiples of a common factor, so that the reduction never reaches 1
+    // and reads the whole array.
+    std::size_t const num_values = 20000000;
+    std::vector<std::uint64_t> values(num_values);
+
+    for (std::uint64_t & value : values)
+    {
+        value = (generator() >> 20) * 6;
+    }
+
+    unsigned const thread_counts[] = { 1, 2, 4 };
+
+    std::cout << "\treduction of " << num_values << " values, gcd 6 :";
+
+    for (unsigned num_threads : thread_counts)
+    {
+        std::uint64_t result = 0;
+        double ms = time_ms([&]() { result = gcd_reduce(values.data(), num_values, num_threads); });
+
+        std::cout << " " << num_threads << " threads " << per_second(num_values, ms) << " M/s" << (result == 6 ? "" : " WRONG") << ";";
+    }
+
+    std::cout << std::endl;
+
+    values[num_values / 3] = 7;
+
+    std::cout << "\treduction reaching 1 at 1/3      :";
+
+    for (unsigned num_threads : thread_counts)
+    {
+        std::uint64_t result = 0;
+        double ms = time_ms([&]() { result = gcd_reduce(values.data(), num_values, num_threads); });
+
+        std::cout << " " << num_threads << " threads " << ms << " ms" << (result == 1 ? "" : " WRONG") << ";";
+    }
+
+    std::cout << std::endl;
+}
+
+Limbs random_limbs(std::mt19937_64 & generator, std::size_t num_limbs)
+{
+    Limbs a(num_limbs);
+
+    for (std::uint64_t & limb : a)
+    {
+        limb = generator();
+    }
+
+    trim_limbs(a);
+    return a;
+}
+
+/*
+ * Whether g is the GCD of a and b: it divides both, and the cofactors
+ * have no common factor left.
+ */
+bool check_lehmer_gcd(Limbs const& a, Limbs const& b, Limbs const& g)
+{
+    if (g.empty())
+    {
+        return a.empty() && b.empty();
+    }
+
+    if (!limbs_mod(a, g).empty() || !limbs_mod(b, g).empty())
+    {
+        return false;
+    }
+
+    if (g != euclid_gcd_limbs(a, b))
+    {
+        return false;
+    }
+
+    return true;
+}
+
+/*
+ * Compares 'lehmer_gcd' with 'euclid_gcd_limbs' and 'binary_gcd', for
+ * values of up to 2 limbs, random values with a large common factor,
+ * consecutive Fibonacci numbers, and values that are powers of 2 apart.
+ */
+void test_lehmer_gcd()
+{
+    std::mt19937_64 generator(41);
+
+    // q * v + r mod v == r, with divisors whose top limbs are all ones or
+    // only the top bit, where the quotient guess is most often too big.
+    for (int round = 0; round < 3000; round++)
+    {
+        Limbs v = random_limbs(generator, 1 + generator() % 6);
+
+        if (v.empty())
+        {
+            continue;
+        }
+
+        if (round % 3 == 1)
+        {
+            v.back() = ~std::uint64_t(0);
+        }
+        else if (round % 3 == 2)
+        {
+            v.back() = std::uint64_t(1) << 63;
+            v[0] |= generator() % 2;
+        }
+
+        Limbs r = limbs_mod(random_limbs(generator, v.size()), v);
+        Limbs u = add_limbs(multiply_limbs(v, random_limbs(generator, 1 + generator() % 6)), r);
+
+        if (limbs_mod(u, v) != r || compare_limbs(r, v) >= 0)
+        {
+            std::cout << "test_lehmer_gcd failed for a division by " << v.size() << " limbs" << std::endl;
+            return;
+        }
+    }
+
+    // The quotient guess of 2^64 - 2 is still 1 too big here, which
+    // only the add back corrects.
+    Limbs const add_back_u = { 0, 0, std::uint64_t(1) << 63, (std::uint64_t(1) << 63) - 1 };
+    Limbs const add_back_v = { 1, 0, std::uint64_t(1) << 63 };
+
+    if (limbs_mod(add_back_u, add_back_v) != Limbs { 2, ~std::uint64_t(0), (std::uint64_t(1) << 63) - 1 })
+    {
+        std::cout << "test_lehmer_gcd failed for the add back" << std::endl;
+        return;
+    }
+
+    for (int round = 0; round < 2000; round++)
+    {
+        unsigned __int128 x = static_cast<unsigned __int128>(generator() >> (generator() % 64)) << 64 | generator();
+        unsigned __int128 y = static_cast<unsigned __int128>(generator() >> (generator() % 64)) << 64 | generator();
+
+        x >>= generator() % 128;
+        y >>= generator() % 128;
+
+        if (from_limbs(lehmer_gcd(to_limbs(x), to_limbs(y))) != binary_gcd(x, y)
+            || from_limbs(euclid_gcd_limbs(to_limbs(x), to_limbs(y))) != binary_gcd(x, y))
+        {
+            std::cout << "test_lehmer_gcd failed for 128-bit values" << std::endl;
+            return;
+        }
+    }
+
+    for (int round = 0; round < 300; round++)
+    {
+        Limbs factor = random_limbs(generator, 1 + generator() % 8);
+        Limbs a = multiply_limbs(factor, random_limbs(generator, 1 + generator() % 40));
+        Limbs b = multiply_limbs(factor, random_limbs(generator, 1 + generator() % 40));
+
+        // Values that agree in their top limbs, and so in their leading
+        // bits, and values a few bits apart in size.
+        if (round % 4 == 1)
+        {
+            b = a;
+            b[0] ^= 1;
+        }
+        else if (round % 4 == 2)
+        {
+            b = limbs_mod(a, multiply_limbs(a.empty() ? Limbs { 1 } : Limbs { a.back() | 1 }, Limbs { 3 }));
+        }
+
+        if (!check_lehmer_gcd(a, b, lehmer_gcd(a, b)) || lehmer_gcd(a, b) != lehmer_gcd(b, a))
+        {
+            std::cout << "test_lehmer_gcd failed for values of " << a.size() << " and " << b.size() << " limbs" << std::endl;
+            return;
+        }
+    }
+
+    Limbs fibonacci_a = { 1 }, fibonacci_b = { 1 };
+
+    while (fibonacci_b.size() < 20)
+    {
+        Limbs sum = add_limbs(fibonacci_a, fibonacci_b);
+
+        fibonacci_a.swap(fibonacci_b);
+        fibonacci_b.swap(sum);
+    }
+
+    Limbs power_a(20, 0), power_b(8, 0);
+    power_a.back() = std::uint64_t(1) << 40;
+    power_b[7] = std::uint64_t(1) << 3;
+
+    // 2^p - 1 and 2^q - 1 have the GCD 2^gcd(p, q) - 1, and their leading
+    // bits are all ones.
+    for (std::size_t p = 129; p <= 1300; p += 97)
+    {
+        for (std::size_t q = 128; q <= p; q += 61)
+        {
+            auto mersenne = [](std::size_t bits) {
+                Limbs m((bits + 63) / 64, ~std::uint64_t(0));
+
+                if (bits % 64 != 0)
+                {
+                    m.back() >>= 64 - bits % 64;
+                }
+
+                return m;
+            };
+
+            if (lehmer_gcd(mersenne(p), mersenne(q)) != mersenne(euclid_gcd(p, q)))
+            {
+                std::cout << "test_lehmer_gcd failed for 2^" << p << " - 1 and 2^" << q << " - 1" << std::endl;
+                return;
+            }
+        }
+    }
+
+    if (lehmer_gcd(fibonacci_a, fibonacci_b) != Limbs { 1 }
+        || lehmer_gcd(power_a, power_b) != power_b
+        || lehmer_gcd(Limbs(), fibonacci_a) != fibonacci_a
+        || !lehmer_gcd(Limbs(), Limbs()).empty()
+        || lehmer_gcd(fibonacci_a, fibonacci_a) != fibonacci_a)
+    {
+        std::cout << "test_lehmer_gcd failed for special values" << std::endl;
+        return;
+    }
+
+    std::cout << "test_lehmer_gcd passed" << std::endl;
+}
+
+void benchmark_lehmer_gcd()
+{
+    std::mt19937_64 generator(43);
+
+    std::cout << std::setprecision(1) << std::fixed;
+    std::cout << "benchmark_lehmer_gcd" << std::endl;
+
+    std::size_t const bit_sizes[] = { 1024, 2048, 4096, 8192 };
+
+    for (std::size_t bits : bit_sizes)
+    {
+        std::size_t const num_pairs = 2000000 / (bits * bits / 1024);
+
+        std::vector<Limbs> xs, ys;
+
+        for (std::size_t i = 0; i < num_pairs; i++)
+        {
+            xs.push_back(random_limbs(generator, bits / 64));
+            ys.push_back(random_limbs(generator, bits / 64));
+        }
+
+        std::size_t sink = 0;
+
+        double ms_euclid = time_ms([&]() {
+            for (std::size_t i = 0; i < num_pairs; i++)
+            {
+                sink += euclid_gcd_limbs(xs[i], ys[i]).size();
+            }
+        });
+
+        double ms_lehmer = time_ms([&]() {
+            for (std::size_t i = 0; i < num_pairs; i++)
+            {
+                sink += lehmer_gcd(xs[i], ys[i]).size();
+            }
+        });
+
+        std::cout << "\t" << std::setw(4) << bits << " bits (" << num_pairs << " pairs) : euclid "
+            << std::setw(8) << ms_euclid * 1e3 / num_pairs << " us, lehmer "
+            << std::setw(7) << ms_lehmer * 1e3 / num_pairs << " us, "
+            << ms_euclid / ms_lehmer << "x" << (sink == 42 ? " " : "") << std::endl;
+    }
+}
+
+void remove_batch_gcd_checkpoints(std::string const& prefix)
+{
+    for (int level = 0; level < 64; level++)
+    {
+        for (char const* name : { "product_", "remainder_" })
+        {
+            std::remove((prefix + name + std::to_string(level)).c_str());
+            std::remove((prefix + name + std::to_string(level) + ".tmp").c_str());
+        }
+    }
+}
+
+/*
+ * Checks the NTT multiplication against the schoolbook one, division by
+ * reciprocal against 'limbs_mod', and 'batch_gcd' against the GCD of each
+ * modulus with the product of the others, with shared factors, duplicates
+ * and a modulus of 1, then resumes from its own checkpoints.
+ */
+void test_batch_gcd()
+{
+    std::mt19937_64 generator(47);
+
+    for (int round = 0; round < 60; round++)
+    {
+        Limbs a = random_limbs(generator, 700 + generator() % 600);
+        Limbs b = round % 3 == 0 ? Limbs(700 + generator() % 600, ~std::uint64_t(0)) : random_limbs(generator, 700 + generator() % 600);
+
+        if (multiply_limbs(a, b) != schoolbook_multiply_limbs(a, b)
+            || multiply_limbs(b, b) != schoolbook_multiply_limbs(b, b))
+        {
+            std::cout << "test_batch_gcd failed for a product of " << a.size() << " and " << b.size() << " limbs" << std::endl;
+            return;
+        }
+    }
+
+    for (int round = 0; round < 300; round++)
+    {
+        Limbs d = random_limbs(generator, 1 + generator() % 200);
+
+        if (d.empty())
+        {
+            continue;
+        }
+
+        if (round % 3 == 1)
+        {
+            d.back() = 1;
+        }
+        else if (round % 3 == 2)
+        {
+            std::fill(d.begin(), d.end(), ~std::uint64_t(0));
+        }
+
+        Limbs const u = random_limbs(generator, generator() % (5 * d.size() + 1));
+
+        if (limbs_mod_by_reciprocal(u, d, reciprocal_limbs(d)) != limbs_mod(u, d))
+        {
+            std::cout << "test_batch_gcd failed for a division by " << d.size() << " limbs" << std::endl;
+            return;
+        }
+    }
+
+    for (int round = 0; round < 6; round++)
+    {
+        std::size_t const num_moduli = 1 + generator() % 70;
+        std::vector<Limbs> factors, moduli;
+
+        for (std::size_t i = 0; i < num_moduli; i++)
+        {
+            factors.push_back(random_limbs(generator, 1 + generator() % 10));
+            factors.back()[0] |= 1;
+        }
+
+        for (std::size_t i = 0; i < num_moduli; i++)
+        {
+            // One in 4 shares a factor with another modulus.
+            Limbs const cofactor = generator() % 4 == 0 ? factors[generator() % num_moduli] : random_limbs(generator, 1 + generator() % 10);
+
+            moduli.push_back(multiply_limbs(factors[i], cofactor));
+
+            if (moduli.back().empty())
+            {
+                moduli.back() = Limbs { 1 };
+            }
+        }
+
+        if (num_moduli > 3)
+        {
+            moduli[1] = moduli[0];
+            moduli[2] = Limbs { 1 };
+        }
+
+        std::vector<Limbs> expected;
+
+        for (std::size_t i = 0; i < num_moduli; i++)
+        {
+            Limbs others = { 1 };
+
+            for (std::size_t j = 0; j < num_moduli; j++)
+            {
+                if (j != i)
+                {
+                    others = multiply_limbs(others, moduli[j]);
+                }
+            }
+
+            expected.push_back(lehmer_gcd(moduli[i], others));
+        }
+
+        for (unsigned num_threads = 1; num_threads <= 3; num_threads += 2)
+        {
+            BatchGcdResult result = batch_gcd(moduli, num_threads);
+
+            if (!result.ok || result.gcds != expected)
+            {
+                std::cout << "test_batch_gcd failed for " << num_moduli << " moduli with " << num_threads << " threads" << std::endl;
+                return;
+            }
+        }
+
+        std::string const prefix = "batch_gcd_test_checkpoint_";
+
+        // Left over from a run that stopped half way, they would be resumed.
+        remove_batch_gcd_checkpoints(prefix);
+
+        BatchGcdResult first = batch_gcd(moduli, 2, prefix);
+        BatchGcdResult resumed = batch_gcd(moduli, 2, prefix);
+
+        // A checkpoint of another batch must not be used.
+        std::vector<Limbs> other_moduli = moduli;
+        other_moduli[0] = add_limbs(other_moduli[0], Limbs { 2 });
+
+        BatchGcdResult other = batch_gcd(other_moduli, 2, prefix);
+
+        // Without the lower remainder levels, the remainder tree resumes
+        // from the lowest one left.
+        std::remove((prefix + "remainder_0").c_str());
+        BatchGcdResult partial = batch_gcd(other_moduli, 2, prefix);
+
+        // A checkpoint cut short, with nothing above it, must be ignored
+        // rather than taking the place of the root.
+        for (int level = 1; level < 64; level++)
+        {
+            std::remove((prefix + "remainder_" + std::to_string(level)).c_str());
+        }
+
+        std::string truncated;
+
+        {
+            std::ifstream in(prefix + "remainder_0", std::ios::binary);
+            truncated.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+        }
+
+        if (!truncated.empty())
+        {
+            std::ofstream out(prefix + "remainder_0", std::ios::binary | std::ios::trunc);
+            out.write(truncated.data(), static_cast<std::streamsize>(truncated.size() / 2));
+        }
+
+        BatchGcdResult after_truncation = batch_gcd(other_moduli, 2, prefix);
+
+        remove_batch_gcd_checkpoints(prefix);
+
+        int const num_levels = first.levels_computed;
+
+        if (!first.ok || first.gcds != expected || first.levels_loaded != 0
+            || !resumed.ok || resumed.gcds != expected || resumed.levels_computed != 0
+            || !other.ok || other.levels_loaded != 0 || other.levels_computed != num_levels
+            || !partial.ok || partial.gcds != other.gcds || (num_moduli > 1 && partial.levels_computed != 1)
+            || !after_truncation.ok || after_truncation.gcds != other.gcds)
+        {
+            std::cout << "test_batch_gcd failed for checkpoints of " << num_moduli << " moduli" << std::endl;
+            return;
+        }
+    }
+
+    std::cout << "test_batch_gcd passed" << std::endl;
+}
+
+/*
+ * Times 'batch_gcd' on 1024-bit moduli, each the product of two random
+ * 512-bit odd values, against the time all the pairwise 'lehmer_gcd' would
+ * take, estimated from a sample of pairs.
+ */
+void benchmark_batch_gcd()
+{
+    std::mt19937_64 generator(53);
+
+    std::cout << std::setprecision(2) << std::fixed;
+    std::cout << "benchmark_batch_gcd (1024-bit moduli, " << std::thread::hardware_concurrency() << " hardware threads)" << std::endl;
+
+    std::size_t const num_sample_pairs = 2000;
+    std::vector<Limbs> sample;
+
+    for (std::size_t i = 0; i < 2 * num_sample_pairs; i++)
+    {
+        sample.push_back(multiply_limbs(random_limbs(generator, 8), random_limbs(generator, 8)));
+    }
+
+    std::size_t sink = 0;
+
+    double const ms_per_pair = time_ms([&]() {
+        for (std::size_t i = 0; i < num_sample_pairs; i++)
+        {
+            sink += lehmer_gcd(sample[2 * i], sample[2 * i + 1]).size();
+        }
+    }) / num_sample_pairs;
+
+    std::size_t const batch_sizes[] = { 1024, 4096, 16384 };
+
+    for (std::size_t num_moduli : batch_sizes)
+    {
+        std::vector<Limbs> moduli;
+
+        for (std::size_t i = 0; i < num_moduli; i++)
+        {
+            moduli.push_back(multiply_limbs(random_limbs(generator, 8), random_limbs(generator, 8)));
+        }
+
+        BatchGcdResult result;
+        double ms = time_ms([&]() { result = batch_gcd(moduli); });
+
+        double const pairs = 0.5 * static_cast<double>(num_moduli) * static_cast<double>(num_moduli - 1);
+
+        std::cout << "\t" << std::setw(6) << num_moduli << " moduli : batch " << std::setw(9) << ms / 1e3
+            << " s, pairwise (estimated) " << std::setw(9) << pairs * ms_per_pair / 1e3 << " s"
+            << (result.ok ? "" : " FAILED") << (sink == 42 ? " " : "") << std::endl;
+    }
+
+    std::vector<Limbs> moduli;
+
+    for (std::size_t i = 0; i < 4096; i++)
+    {
+        moduli.push_back(multiply_limbs(random_limbs(generator, 8), random_limbs(generator, 8)));
+    }
+
+    std::string const prefix = "batch_gcd_benchmark_checkpoint_";
+
+    remove_batch_gcd_checkpoints(prefix);
+
+    BatchGcdResult result;
+    double ms_checkpointed = time_ms([&]() { result = batch_gcd(moduli, std::thread::hardware_concurrency(), prefix); });
+    double ms_resumed = time_ms([&]() { result = batch_gcd(moduli, std::thread::hardware_concurrency(), prefix); });
+
+    remove_batch_gcd_checkpoints(prefix);
+
+    std::cout << "\t  4096 moduli, checkpointed : " << ms_checkpointed / 1e3 << " s, resumed from the checkpoints "
+        << ms_resumed / 1e3 << " s" << (result.ok ? "" : " FAILED") << std::endl;
+}
+
+template <typename Function>
+double time_ms(Function function)
+{
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    function();
+
+    std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+
+    return std::chrono::duration<double, std::milli>(end - start).count();
 }
\ No newline at end of file
@@ -7,6 +7,16 @@
 
 #include <iostream>
 #include <limits>
+#include <vector>
+#include <utility>
+#include <random>
+#include <climits>
+#include <cstdint>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <iomanip>
+#include <algorithm>
 
 // Ideally, we should use unique_ptr's here instead of naked pointers.
 struct node
@@ -24,8 +34,17 @@ struct node
 // Check if a binary tree is a Binary Search Tree.
 bool is_bst(node * nd);
 
+// Same, in constant extra space and without recursion.
+bool is_bst_morris(node * root);
+
+// Same, with the subtrees below 'split_depth' checked by 'num_threads' threads.
+bool is_bst_parallel(node * root, unsigned num_threads = std::thread::hardware_concurrency(), int split_depth = -1);
+
 void test_success_00();
 void test_failure_00();
+void test_is_bst_morris();
+void test_is_bst_parallel();
+void benchmark_is_bst();
 
 int main()
 {
@@ -33,6 +52,12 @@ int main()
 
 	test_failure_00();
 
+	test_is_bst_morris();
+
+	test_is_bst_parallel();
+
+	benchmark_is_bst();
+
 	return 0;
 }
 
@@ -78,6 +103,240 @@ bool is_bst(node * nd)
 	return true;
 }
 
+/*
+ * An in-order Morris traversal: before going down into the left subtree of
+ * a node, the right pointer of its in-order predecessor, which is null, is
+ * pointed at the node. Coming back up along that thread finds the
+ * predecessor again, which gets its null back. So the walk needs no stack,
+ * and the tree is as it was once it is done.
+ *
+ * The keys must be strictly increasing in that order. The previous key is
+ * kept with a flag for whether there is one, rather than starting from a
+ * sentinel, so that INT_MIN and INT_MAX are keys like any other.
+ *
+ * On the first violation, no more threads are made: a left subtree not
+ * entered yet is skipped, going right instead, and a thread found on the
+ * way is taken out. Going right from there only leads back along the
+ * threads still in place, so the walk stops after the paths up to them,
+ * not the rest of the tree.
+ */
+bool is_bst_morris(node * root)
+{
+	bool valid = true;
+	bool has_prev = false;
+	int prev = 0;
+	std::size_t open_threads = 0;
+
+	node * nd = root;
+
+	auto visit = [&](node * current) {
+		if (valid && has_prev && current->val <= prev)
+		{
+			valid = false;
+		}
+
+		has_prev = true;
+		prev = current->val;
+	};
+
+	while (nd != nullptr && (valid || open_threads != 0))
+	{
+		if (nd->left == nullptr)
+		{
+			visit(nd);
+			nd = nd->right;
+			continue;
+		}
+
+		node * predecessor = nd->left;
+
+		while (predecessor->right != nullptr && predecessor->right != nd)
+		{
+			predecessor = predecessor->right;
+		}
+
+		if (predecessor->right == nullptr)
+		{
+			if (!valid)
+			{
+				nd = nd->right;
+				continue;
+			}
+
+			predecessor->right = nd;
+			open_threads++;
+			nd = nd->left;
+		}
+		else
+		{
+			predecessor->right = nullptr;
+			open_threads--;
+			visit(nd);
+			nd = nd->right;
+		}
+	}
+
+	return valid;
+}
+
+/*
+ * A subtree, with the open interval its keys must be in. The bounds are 64
+ * bits wide so that INT_MIN - 1 and INT_MAX + 1 can stand for no bound.
+ */
+struct bounded_subtree
+{
+	node * nd;
+	std::int64_t min;
+	std::int64_t max;
+};
+
+/*
+ * 'is_bst_helper' with a stack of its own, so that a deep subtree cannot
+ * overflow the call stack. Gives up, as if valid, once 'cancelled' is set,
+ * which is checked every so many nodes.
+ */
+bool is_bst_subtree(bounded_subtree root, std::atomic<bool> const& cancelled)
+{
+	if (root.nd == nullptr)
+	{
+		return true;
+	}
+
+	std::vector<bounded_subtree> pending;
+	bounded_subtree subtree = root;
+	std::size_t num_visited = 0;
+
+	// Down the left children in place, with the right ones kept for later.
+	while (true)
+	{
+		if (++num_visited % 1024 == 0 && cancelled.load(std::memory_order_relaxed))
+		{
+			return true;
+		}
+
+		node * nd = subtree.nd;
+		std::int64_t val = nd->val;
+
+		if (val <= subtree.min || val >= subtree.max)
+		{
+			return false;
+		}
+
+		if (nd->right != nullptr)
+		{
+			pending.push_back(bounded_subtree { nd->right, val, subtree.max });
+		}
+
+		if (nd->left != nullptr)
+		{
+			subtree = bounded_subtree { nd->left, subtree.min, val };
+		}
+		else if (!pending.empty())
+		{
+			subtree = pending.back();
+			pending.pop_back();
+		}
+		else
+		{
+			return true;
+		}
+	}
+}
+
+/*
+ * The nodes above 'split_depth' are checked first, on the calling thread,
+ * and the subtrees hanging below them become the tasks, left to right,
+ * with the bounds the path down to them sets. The threads then take tasks
+ * in turn from a shared counter, which evens out subtrees of different
+ * sizes. The first task to find a violation sets 'cancelled': the tasks not
+ * started yet are skipped, and the ones running give up within a
+ * thousand nodes.
+ *
+ * By default, the split is deep enough for about 8 tasks per thread.
+ */
+bool is_bst_parallel(node * root, unsigned num_threads, int split_depth)
+{
+	num_threads = std::max(1u, num_threads);
+
+	if (split_depth < 0)
+	{
+		split_depth = 3;
+
+		while ((1u << split_depth) < 8 * num_threads && split_depth < 20)
+		{
+			split_depth++;
+		}
+	}
+
+	std::int64_t const no_min = std::int64_t(INT_MIN) - 1;
+	std::int64_t const no_max = std::int64_t(INT_MAX) + 1;
+
+	std::vector<bounded_subtree> tasks;
+	std::vector<bounded_subtree> level(1, bounded_subtree { root, no_min, no_max });
+
+	for (int depth = 0; depth < split_depth && !level.empty(); depth++)
+	{
+		std::vector<bounded_subtree> below;
+
+		for (bounded_subtree const& subtree : level)
+		{
+			if (subtree.nd == nullptr)
+			{
+				continue;
+			}
+
+			std::int64_t val = subtree.nd->val;
+
+			if (val <= subtree.min || val >= subtree.max)
+			{
+				return false;
+			}
+
+			below.push_back(bounded_subtree { subtree.nd->left, subtree.min, val });
+			below.push_back(bounded_subtree { subtree.nd->right, val, subtree.max });
+		}
+
+		level.swap(below);
+	}
+
+	for (bounded_subtree const& subtree : level)
+	{
+		if (subtree.nd != nullptr)
+		{
+			tasks.push_back(subtree);
+		}
+	}
+
+	std::atomic<bool> cancelled(false);
+	std::atomic<std::size_t> next_task(0);
+
+	auto worker = [&]() {
+		for (std::size_t i = next_task++; i < tasks.size() && !cancelled.load(std::memory_order_relaxed); i = next_task++)
+		{
+			if (!is_bst_subtree(tasks[i], cancelled))
+			{
+				cancelled.store(true, std::memory_order_relaxed);
+			}
+		}
+	};
+
+	std::vector<std::thread> threads;
+
+	for (unsigned i = 1; i < std::min<std::size_t>(num_threads, tasks.size()); i++)
+	{
+		threads.emplace_back(worker);
+	}
+
+	worker();
+
+	for (std::thread & thread : threads)
+	{
+		thread.join();
+	}
+
+	return !cancelled.load();
+}
+
 /*
 				 20
 			         .
@@ -173,3 +432,367 @@ void test_failure_00()
 	delete right_30;
 	delete root;
 }
+
+/*
+ * Frees a tree of any depth, with a stack of its own.
+ */
+void delete_tree(node * root)
+{
+	std::vector<node *> pending;
+
+	if (root != nullptr)
+	{
+		pending.push_back(root);
+	}
+
+	while (!pending.empty())
+	{
+		node * nd = pending.back();
+		pending.pop_back();
+
+		if (nd->left != nullptr)
+		{
+			pending.push_back(nd->left);
+		}
+
+		if (nd->right != nullptr)
+		{
+			pending.push_back(nd->right);
+		}
+
+		delete nd;
+	}
+}
+
+/*
+ * Every node's pointers, in pre-order, to check that the tree is restored.
+ */
+std::vector<std::pair<node *, node *> > tree_links(node * root)
+{
+	std::vector<std::pair<node *, node *> > links;
+	std::vector<node *> pending;
+
+	if (root != nullptr)
+	{
+		pending.push_back(root);
+	}
+
+	while (!pending.empty())
+	{
+		node * nd = pending.back();
+		pending.pop_back();
+
+		links.push_back(std::make_pair(nd->left, nd->right));
+
+		if (nd->right != nullptr)
+		{
+			pending.push_back(nd->right);
+		}
+
+		if (nd->left != nullptr)
+		{
+			pending.push_back(nd->left);
+		}
+	}
+
+	return links;
+}
+
+/*
+ * The chain a sorted insert makes: keys first, first + 1, ..., each node
+ * the right child of the previous one, or the left child for descending
+ * keys.
+ */
+node * make_chain(std::size_t num_nodes, int first, bool descending)
+{
+	node * root = nullptr;
+	node * last = nullptr;
+
+	for (std::size_t i = 0; i < num_nodes; i++)
+	{
+		int key = first + static_cast<int>(i);
+		node * nd = new node(descending ? -key : key);
+
+		if (last == nullptr)
+		{
+			root = nd;
+		}
+		else if (descending)
+		{
+			last->left = nd;
+		}
+		else
+		{
+			last->right = nd;
+		}
+
+		last = nd;
+	}
+
+	return root;
+}
+
+/*
+ * A balanced BST of the keys [first, first + num_nodes), one apart.
+ */
+node * make_balanced(int first, int num_nodes)
+{
+	if (num_nodes <= 0)
+	{
+		return nullptr;
+	}
+
+	int half = num_nodes / 2;
+	node * nd = new node(first + half);
+
+	nd->left = make_balanced(first, half);
+	nd->right = make_balanced(first + half + 1, num_nodes - half - 1);
+
+	return nd;
+}
+
+bool check_is_bst_morris(node * root, bool expected)
+{
+	std::vector<std::pair<node *, node *> > links = tree_links(root);
+
+	return is_bst_morris(root) == expected && tree_links(root) == links;
+}
+
+/*
+ * Checks 'is_bst_morris' against 'is_bst' on small balanced trees with a
+ * key moved, then on INT_MIN and INT_MAX keys, duplicates, and chains of
+ * millions of nodes with and without a violation, checking each time that
+ * the tree is restored.
+ */
+void test_is_bst_morris()
+{
+	std::mt19937 generator(17);
+
+	for (int round = 0; round < 2000; round++)
+	{
+		int num_nodes = static_cast<int>(generator() % 40);
+		node * root = make_balanced(-20, num_nodes);
+
+		if (num_nodes > 0 && generator() % 2 == 0)
+		{
+			std::vector<node *> nodes(1, root);
+
+			for (std::size_t i = 0; i < nodes.size(); i++)
+			{
+				if (nodes[i]->left != nullptr)
+				{
+					nodes.push_back(nodes[i]->left);
+				}
+
+				if (nodes[i]->right != nullptr)
+				{
+					nodes.push_back(nodes[i]->right);
+				}
+			}
+
+			nodes[generator() % nodes.size()]->val = static_cast<int>(generator() % 50) - 25;
+		}
+
+		bool ok = check_is_bst_morris(root, is_bst(root));
+
+		delete_tree(root);
+
+		if (!ok)
+		{
+			std::cout << "test_is_bst_morris failed for a balanced tree of " << num_nodes << " nodes" << std::endl;
+			return;
+		}
+	}
+
+	node * extremes = new node(0);
+	extremes->left = new node(INT_MIN);
+	extremes->right = new node(INT_MAX);
+
+	node * duplicates = new node(5);
+	duplicates->left = new node(5);
+
+	bool ok = check_is_bst_morris(extremes, true)
+		&& check_is_bst_morris(duplicates, false)
+		&& check_is_bst_morris(nullptr, true)
+		&& !is_bst(extremes);
+
+	delete_tree(extremes);
+	delete_tree(duplicates);
+
+	std::size_t const num_nodes = 3000000;
+
+	node * ascending = make_chain(num_nodes, 0, false);
+	node * descending = make_chain(num_nodes, 0, true);
+
+	ok = ok && check_is_bst_morris(ascending, true) && check_is_bst_morris(descending, true);
+
+	// A violation at the very bottom of each chain, then one half way down
+	// the left chain, above millions of threads to take out again.
+	node * bottom = ascending;
+	node * middle = descending;
+
+	while (bottom->right != nullptr)
+	{
+		bottom = bottom->right;
+	}
+
+	for (std::size_t i = 0; i < num_nodes / 2; i++)
+	{
+		middle = middle->left;
+	}
+
+	bottom->val = -1;
+	ok = ok && check_is_bst_morris(ascending, false);
+
+	middle->left->val = middle->val + 1;
+	ok = ok && check_is_bst_morris(descending, false);
+
+	delete_tree(ascending);
+	delete_tree(descending);
+
+	std::cout << (ok ? "test_is_bst_morris passed" : "test_is_bst_morris failed") << std::endl;
+}
+
+/*
+ * Checks 'is_bst_parallel' against 'is_bst' on small trees with a key
+ * moved, for several thread counts and split depths, including splits
+ * deeper than the tree, then on INT_MIN and INT_MAX keys and on a chain
+ * of millions of nodes.
+ */
+void test_is_bst_parallel()
+{
+	std::mt19937 generator(19);
+
+	for (int round = 0; round < 2000; round++)
+	{
+		int num_nodes = static_cast<int>(generator() % 200);
+		node * root = make_balanced(-100, num_nodes);
+
+		if (num_nodes > 0 && generator() % 2 == 0)
+		{
+			std::vector<node *> nodes(1, root);
+
+			for (std::size_t i = 0; i < nodes.size(); i++)
+			{
+				if (nodes[i]->left != nullptr)
+				{
+					nodes.push_back(nodes[i]->left);
+				}
+
+				if (nodes[i]->right != nullptr)
+				{
+					nodes.push_back(nodes[i]->right);
+				}
+			}
+
+			nodes[generator() % nodes.size()]->val = static_cast<int>(generator() % 220) - 110;
+		}
+
+		bool expected = is_bst(root);
+		unsigned num_threads = 1 + generator() % 4;
+		int split_depth = static_cast<int>(generator() % 10) - 1;
+
+		bool ok = is_bst_parallel(root, num_threads, split_depth) == expected;
+
+		delete_tree(root);
+
+		if (!ok)
+		{
+			std::cout << "test_is_bst_parallel failed for " << num_nodes << " nodes, " << num_threads << " threads, split at " << split_depth << std::endl;
+			return;
+		}
+	}
+
+	node * extremes = new node(0);
+	extremes->left = new node(INT_MIN);
+	extremes->right = new node(INT_MAX);
+	extremes->right->left = new node(INT_MAX);
+
+	bool ok = !is_bst_parallel(extremes, 2, 0) && !is_bst_parallel(extremes, 2, 2);
+
+	delete extremes->right->left;
+	extremes->right->left = nullptr;
+
+	ok = ok && is_bst_parallel(extremes, 2, 0) && is_bst_parallel(extremes, 2, 1) && is_bst_parallel(nullptr, 2);
+
+	delete_tree(extremes);
+
+	node * chain = make_chain(3000000, 0, false);
+
+	ok = ok && is_bst_parallel(chain, 4, 2);
+
+	delete_tree(chain);
+
+	std::cout << (ok ? "test_is_bst_parallel passed" : "test_is_bst_parallel failed") << std::endl;
+}
+
+template <typename Function>
+double time_ms(Function function)
+{
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	function();
+
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+/*
+ * Times the validators on a balanced tree of 4M nodes: valid, with a
+ * violation at its last in-order node, which a left to right check only
+ * finds at the very end, and with one at its first in-order node, which
+ * they should all give up on at once.
+ */
+void benchmark_is_bst()
+{
+	int const num_nodes = (1 << 22) - 1;
+
+	node * root = make_balanced(0, num_nodes);
+	node * first = root;
+	node * last = root;
+	node * last_parent = nullptr;
+
+	while (first->left != nullptr)
+	{
+		first = first->left;
+	}
+
+	while (last->right != nullptr)
+	{
+		last_parent = last;
+		last = last->right;
+	}
+
+	std::cout << std::setprecision(3) << std::fixed;
+	std::cout << "benchmark_is_bst (" << num_nodes << " nodes, " << std::thread::hardware_concurrency() << " hardware threads)" << std::endl;
+
+	unsigned const thread_counts[] = { 1, 2, 4, 8 };
+
+	char const* const cases[] = { "valid                 ", "violation at the end  ", "violation at the start" };
+
+	for (int violation = 0; violation < 3; violation++)
+	{
+		last->val = violation == 1 ? last_parent->val : num_nodes - 1;
+		first->val = violation == 2 ? num_nodes + 1 : 0;
+
+		bool const expected = (violation == 0);
+		bool results[2] = {};
+		bool parallel_ok = true;
+
+		double ms_recursive = time_ms([&]() { results[0] = is_bst(root); });
+		double ms_morris = time_ms([&]() { results[1] = is_bst_morris(root); });
+
+		std::cout << "\t" << cases[violation]
+			<< " : recursive " << ms_recursive << " ms, morris " << ms_morris << " ms, parallel";
+
+		for (unsigned num_threads : thread_counts)
+		{
+			double ms_parallel = time_ms([&]() { parallel_ok &= is_bst_parallel(root, num_threads) == expected; });
+
+			std::cout << " " << num_threads << ": " << ms_parallel << " ms;";
+		}
+
+		std::cout << ((results[0] == expected && results[1] == expected && parallel_ok) ? "" : " WRONG") << std::endl;
+	}
+
+	delete_tree(root);
+}
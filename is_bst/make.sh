@@ -2,6 +2,6 @@
 
 clear
 
-g++ -std=c++14 -Wall -Werror -o test.o main.cpp
+g++ -std=c++14 -O2 -Wall -Werror -pthread -o test.o main.cpp
 
 ./test.o